@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <string.h>
+#include "access.h"
+#include "config.h"
+#include "hal.h"
+
+// Signed payloads end in "exp=<unix seconds>...&sig=<hex HMAC-SHA256>";
+// the MAC covers everything before the separator ahead of "sig=".
+#define SIG_PARAM "sig="
+#define EXP_PARAM "exp="
+#define SIG_HEX_LEN 64
+
+#define CACHE_WAYS 4
+#define CACHE_DIGEST_LEN 16 // truncated SHA-256 of the payload
+#define CACHE_MAGIC 0x41434332UL
+#define CACHE_STORAGE_KEY "access_cache"
+
+struct CacheEntry
+{
+  uint8_t digest[CACHE_DIGEST_LEN];
+  uint32_t expiresUnix; // 0 = empty
+  uint32_t unlockMs;    // as set by the server, 0 = default
+};
+
+struct CacheTable
+{
+  uint32_t magic;
+  uint32_t sets;
+  CacheEntry entries[ACCESS_CACHE_SETS * CACHE_WAYS];
+};
+
+static CacheTable *cache;
+static HalMutex cacheMutex; // validation workers update the table concurrently
+static bool cacheDirty = false;
+static uint32_t lastPersistMs = 0;
+
+static void payloadDigest(const char *payload, uint8_t digest[CACHE_DIGEST_LEN])
+{
+  uint8_t full[32];
+  halSha256((const uint8_t *)payload, strlen(payload), full);
+  memcpy(digest, full, CACHE_DIGEST_LEN);
+}
+
+static CacheEntry *cacheSet(const uint8_t digest[CACHE_DIGEST_LEN])
+{
+  uint32_t index;
+  memcpy(&index, digest, sizeof(index));
+  return &cache->entries[(index % ACCESS_CACHE_SETS) * CACHE_WAYS];
+}
+
+bool accessInit()
+{
+  cacheMutex = halMutexCreate();
+  cache = (CacheTable *)halAllocLarge(sizeof(CacheTable));
+  if (!cache || !cacheMutex)
+    return false;
+
+  if (halStorageLoad(CACHE_STORAGE_KEY, cache, sizeof(CacheTable)) && cache->magic == CACHE_MAGIC &&
+      cache->sets == ACCESS_CACHE_SETS)
+  {
+    halLog("ACCESS: restored cache from flash\n");
+  }
+  else
+  {
+    memset(cache, 0, sizeof(CacheTable));
+    cache->magic = CACHE_MAGIC;
+    cache->sets = ACCESS_CACHE_SETS;
+  }
+  lastPersistMs = halMillis();
+  return true;
+}
+
+static bool cacheLookup(const char *payload, uint32_t now, uint32_t *unlockMs)
+{
+  uint8_t digest[CACHE_DIGEST_LEN];
+  payloadDigest(payload, digest);
+  CacheEntry *set = cacheSet(digest);
+  for (int way = 0; way < CACHE_WAYS; way++)
+  {
+    if (set[way].expiresUnix > now && memcmp(set[way].digest, digest, CACHE_DIGEST_LEN) == 0)
+    {
+      *unlockMs = set[way].unlockMs;
+      return true;
+    }
+  }
+  return false;
+}
+
+#ifdef ACCESS_HMAC_KEY
+static int hexValue(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+#endif
+
+static bool signatureValid(const char *payload, uint32_t now)
+{
+#ifdef ACCESS_HMAC_KEY
+  const char *sig = strstr(payload, SIG_PARAM);
+  if (!sig || sig == payload || (sig[-1] != '&' && sig[-1] != '?'))
+    return false;
+  const char *hex = sig + strlen(SIG_PARAM);
+  if (strlen(hex) != SIG_HEX_LEN)
+    return false;
+
+  size_t signedLen = (size_t)(sig - 1 - payload);
+  const char *exp = strstr(payload, EXP_PARAM);
+  if (!exp || exp >= sig)
+    return false;
+  uint32_t expires = (uint32_t)strtoul(exp + strlen(EXP_PARAM), NULL, 10);
+  if (expires <= now)
+    return false;
+
+  static const char key[] = ACCESS_HMAC_KEY;
+  uint8_t mac[32];
+  halHmacSha256((const uint8_t *)key, sizeof(key) - 1, (const uint8_t *)payload, signedLen, mac);
+
+  // Constant-time compare
+  uint8_t diff = 0;
+  for (int i = 0; i < 32; i++)
+  {
+    int hi = hexValue(hex[i * 2]);
+    int lo = hexValue(hex[i * 2 + 1]);
+    if (hi < 0 || lo < 0)
+      return false;
+    diff |= (uint8_t)((hi << 4 | lo) ^ mac[i]);
+  }
+  return diff == 0;
+#else
+  (void)payload;
+  (void)now;
+  return false;
+#endif
+}
+
+AccessDecision accessCheckLocal(const char *payload, uint32_t *unlockMs)
+{
+  *unlockMs = 0;
+
+  // Both paths need wall-clock time for expiry
+  uint32_t now = halUnixTime();
+  if (now == 0 || !cache)
+    return ACCESS_UNKNOWN;
+
+  if (signatureValid(payload, now))
+    return ACCESS_GRANT_SIGNED;
+
+  halMutexLock(cacheMutex);
+  bool cached = cacheLookup(payload, now, unlockMs);
+  halMutexUnlock(cacheMutex);
+  return cached ? ACCESS_GRANT_CACHED : ACCESS_UNKNOWN;
+}
+
+void accessRecordGrant(const char *payload, uint32_t ttlSeconds, uint32_t unlockMs)
+{
+  uint32_t now = halUnixTime();
+  if (ttlSeconds == 0)
+  {
+    accessRecordDeny(payload); // the server no longer wants this cached
+    return;
+  }
+  if (now == 0 || !cache)
+    return;
+
+  uint8_t digest[CACHE_DIGEST_LEN];
+  payloadDigest(payload, digest);
+  halMutexLock(cacheMutex);
+  CacheEntry *set = cacheSet(digest);
+
+  // Reuse the matching way, else the one expiring first (empty ways are 0)
+  CacheEntry *slot = &set[0];
+  for (int way = 0; way < CACHE_WAYS; way++)
+  {
+    if (memcmp(set[way].digest, digest, CACHE_DIGEST_LEN) == 0)
+    {
+      slot = &set[way];
+      break;
+    }
+    if (set[way].expiresUnix < slot->expiresUnix)
+      slot = &set[way];
+  }
+  memcpy(slot->digest, digest, CACHE_DIGEST_LEN);
+  slot->expiresUnix = now + ttlSeconds;
+  slot->unlockMs = unlockMs;
+  cacheDirty = true;
+  halMutexUnlock(cacheMutex);
+}
+
+void accessRecordDeny(const char *payload)
+{
+  if (!cache)
+    return;
+
+  uint8_t digest[CACHE_DIGEST_LEN];
+  payloadDigest(payload, digest);
+  halMutexLock(cacheMutex);
+  CacheEntry *set = cacheSet(digest);
+  for (int way = 0; way < CACHE_WAYS; way++)
+  {
+    if (set[way].expiresUnix != 0 && memcmp(set[way].digest, digest, CACHE_DIGEST_LEN) == 0)
+    {
+      memset(&set[way], 0, sizeof(CacheEntry));
+      cacheDirty = true;
+    }
+  }
+  halMutexUnlock(cacheMutex);
+}
+
+void accessPersist()
+{
+  if (!cache)
+    return;
+
+  halMutexLock(cacheMutex);
+  if (cacheDirty && halMillis() - lastPersistMs >= ACCESS_CACHE_PERSIST_MS)
+  {
+    if (halStorageSave(CACHE_STORAGE_KEY, cache, sizeof(CacheTable)))
+      cacheDirty = false;
+    else
+      halLog("ACCESS: cache persist failed\n");
+    lastPersistMs = halMillis();
+  }
+  halMutexUnlock(cacheMutex);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// Local access decisions. Keeps a TTL cache of recently granted payloads
+// (set-associative table in PSRAM, persisted to flash) and verifies
+// HMAC-signed payloads, so most grants need no network round trip.
+// Safe to call from several validation workers at once.
+
+#include <stdint.h>
+
+enum AccessDecision
+{
+  ACCESS_UNKNOWN,      // ask the server
+  ACCESS_GRANT_CACHED, // granted by the server within the grant's TTL
+  ACCESS_GRANT_SIGNED  // carries a valid, unexpired signature
+};
+
+bool accessInit();
+// *unlockMs gets the unlock duration the server set with a cached grant
+// (0 = LOCK_UNLOCK_DURATION_MS)
+AccessDecision accessCheckLocal(const char *payload, uint32_t *unlockMs);
+void accessRecordGrant(const char *payload, uint32_t ttlSeconds, uint32_t unlockMs);
+void accessRecordDeny(const char *payload);
+
+// Writes the cache to flash if it changed and ACCESS_CACHE_PERSIST_MS has
+// passed since the last write.
+void accessPersist();
@@ -0,0 +1,729 @@
+#include <stdio.h>
+#include <string.h>
+#include "access.h"
+#include "app.h"
+#include "audit.h"
+#include "buzzer.h"
+#include "config.h"
+#include "display.h"
+#include "frame_ring.h"
+#include "grant.h"
+#include "hal.h"
+#include "latency.h"
+#include "lcd.h"
+#include "metrics.h"
+#include "profiler.h"
+#include "qr_decoder.h"
+#include "recent.h"
+#include "scheduler.h"
+#include "tuner.h"
+
+// Queues
+HalQueue urlQueue;    // accepted scans -> validation workers
+HalQueue urlSlotFree; // indices of unused urlSlots
+HalQueue resultQueue; // validation workers -> resultTask
+
+// State flags
+volatile bool isUnlocked = false; // true if lock is currently unlocked
+
+// Scans handed to the workers and results acted on; the difference is the
+// number still in flight. Each counter has a single writer.
+volatile uint32_t scansQueued = 0; // written by qrCodeTask, also the last scan id
+volatile uint32_t scansDone = 0;   // written by resultTask
+
+// Scanned URLs stay in this pool and urlQueue carries slot indices, so a
+// scan is never copied by value through the queue. There is a slot for
+// every queue entry plus one per worker, so a slot is free whenever the
+// queue has room.
+#define URL_SLOTS (URL_QUEUE_DEPTH + VALIDATION_WORKERS)
+static char urlSlots[URL_SLOTS][QR_PAYLOAD_LEN];
+
+// Per-worker ArduinoJson arenas for the server's replies
+alignas(alignof(max_align_t)) static uint8_t grantArenas[VALIDATION_WORKERS][GRANT_ARENA_BYTES];
+
+// Time tracking
+unsigned long lastInvalidMs = 0;
+unsigned long lastSeenQrMs = 0;
+
+// ---------------------- MESSAGE STRUCTS ----------------------
+struct UrlMessage
+{
+  uint32_t scanId;
+  uint8_t slot;        // urlSlots entry holding the URL, owned by the receiver
+  uint64_t payloadHash; // recentScanHash() of the URL
+  uint64_t frameUs;    // capture time of the frame the QR came from
+  uint64_t enqueuedUs; // time the URL was handed to urlQueue
+};
+
+struct ScanResult
+{
+  uint32_t scanId;
+  bool granted;
+  uint32_t unlockMs;         // 0 = LOCK_UNLOCK_DURATION_MS
+  char text[GRANT_TEXT_LEN]; // server's result line, empty = ACCESS GRANTED/DENIED
+  uint64_t frameUs;          // capture time of the frame the QR came from
+  uint64_t decidedUs;        // time the worker reached the decision
+  uint64_t payloadHash;      // recentScanHash() of the payload
+};
+
+// ---------------------- POWER ----------------------
+// Steps down through the power tiers while nothing happens in front of the
+// camera. A code or motion goes straight back to full rate; deep sleep is
+// the last tier. In the active tier nothing is polled: powerTimer is the
+// inactivity deadline and every scan re-arms it. Below it, motion is
+// checked every POWER_MOTION_POLL_MS so it restores the frame rate quickly.
+// The handlers run on the scheduler task, which owns this state.
+enum PowerTier
+{
+  POWER_ACTIVE,
+  POWER_IDLE,    // slower frames, CPU and radio power save
+  POWER_STANDBY  // sensor clock slowed as well
+};
+
+static const char *const powerTierNames[] = {"active", "idle", "standby"};
+
+static volatile PowerTier powerTier = POWER_ACTIVE; // read by qrCodeTask
+static unsigned long settledMs = 0; // motion before this is the sensor adjusting to a clock or tuning change
+static unsigned long countdownS = 0; // last "Time to shutdown" logged
+static SchedTimer powerTimer;
+
+#if CAMERA_AUTO_TUNE
+static CameraTuning tuning;
+static SchedTimer tuneTimer;
+
+static void tuningApply(const CameraTuning *tuning)
+{
+  halCameraTune(tuning);
+  halLog("Camera: %s, exposure %+d, gain ceiling %dx.\n", tuning->highRes ? "VGA" : "QVGA", tuning->aeLevel,
+         2 << tuning->gainCeiling);
+}
+#endif
+
+static void powerTierSet(PowerTier tier)
+{
+  frameRingSetInterval(tier == POWER_STANDBY ? POWER_STANDBY_FRAME_MS : tier == POWER_IDLE ? POWER_IDLE_FRAME_MS : 0);
+  halCameraStandby(tier == POWER_STANDBY);
+  halPowerSave(tier != POWER_ACTIVE);
+  halLog("Power: %s.\n", powerTierNames[tier]);
+  powerTier = tier;
+
+  // Sensor tuning only while someone is there to judge it by
+#if CAMERA_AUTO_TUNE
+  if (tier == POWER_ACTIVE)
+    schedAfter(&tuneTimer, TUNE_WINDOW_MS);
+  else
+    schedCancel(&tuneTimer);
+#endif
+}
+
+// Deep sleep is reached in steps on shutdownTimer rather than by waiting
+// inside a handler, so relocking and the button stay on time meanwhile
+enum ShutdownStep
+{
+  SHUTDOWN_NONE,
+  SHUTDOWN_MESSAGE, // "shutting down..." on show
+  SHUTDOWN_TUNE     // shutdown tune playing
+};
+
+static ShutdownStep shutdownStep = SHUTDOWN_NONE;
+static unsigned long tuneStartMs = 0;
+static SchedTimer shutdownTimer;
+
+static void powerOff()
+{
+  halLog("Shutdown: time expired. Entering deep sleep.\n");
+
+  displayShow(0, "shutting down...", true);
+
+  // Leave the message up for a moment so the user can see it
+  shutdownStep = SHUTDOWN_MESSAGE;
+  schedAfter(&shutdownTimer, 2000);
+}
+
+static void shutdownNext(void *arg)
+{
+  unsigned long now = halMillis();
+  if (shutdownStep == SHUTDOWN_MESSAGE)
+  {
+    displayOff();
+    beepShutdown();
+    shutdownStep = SHUTDOWN_TUNE;
+    tuneStartMs = now;
+  }
+  else if (buzzerWaitIdle(0) || now - tuneStartMs >= 1000)
+  {
+    auditFlush();
+    halDeepSleep();
+    return;
+  }
+  schedAfter(&shutdownTimer, 50); // until the tune ends, for at most a second
+}
+
+static void powerCheck(void *arg)
+{
+  if (shutdownStep != SHUTDOWN_NONE)
+    return; // on the way to deep sleep
+  unsigned long lastActiveMs = lastSeenQrMs;
+  unsigned long motionMs = halCameraMotionMs();
+  if ((long)(motionMs - settledMs) >= 0 && (long)(motionMs - lastActiveMs) > 0)
+    lastActiveMs = motionMs;
+
+  unsigned long now = halMillis();
+  unsigned long elapsedTime = now - lastActiveMs;
+
+  PowerTier wanted = POWER_ACTIVE;
+  if (elapsedTime >= POWER_STANDBY_AFTER_MS)
+    wanted = POWER_STANDBY;
+  else if (elapsedTime >= POWER_IDLE_AFTER_MS)
+    wanted = POWER_IDLE;
+  if (wanted != powerTier)
+  {
+    if ((wanted == POWER_STANDBY) != (powerTier == POWER_STANDBY))
+      settledMs = now + POWER_SETTLE_MS;
+    powerTierSet(wanted);
+  }
+
+  if (elapsedTime > SHUTDOWN_AFTER_MS)
+  {
+    powerOff();
+    return;
+  }
+
+  unsigned long remainingSeconds = (SHUTDOWN_AFTER_MS - elapsedTime) / 1000;
+  if (remainingSeconds <= 10 && remainingSeconds != countdownS)
+  {
+    halLog("Time to shutdown: %lu seconds\n", remainingSeconds);
+    countdownS = remainingSeconds;
+  }
+
+  if (powerTier == POWER_ACTIVE)
+    schedAt(&powerTimer, lastActiveMs + POWER_IDLE_AFTER_MS);
+  else
+    schedAfter(&powerTimer, POWER_MOTION_POLL_MS);
+}
+
+// A scan re-arms the inactivity deadline; below the active tier it is due
+// at once, so the frame rate comes back with the first code
+static void powerActivity(unsigned long now)
+{
+  schedAt(&powerTimer, powerTier == POWER_ACTIVE ? now + POWER_IDLE_AFTER_MS : now);
+}
+
+#if CAMERA_AUTO_TUNE
+static void tuneCheck(void *arg)
+{
+  QrDecodeStats decodeStats;
+  halCameraDecodeStats(&decodeStats);
+  unsigned long now = halMillis();
+  if (tunerUpdate(&decodeStats, now, &tuning))
+  {
+    settledMs = now + POWER_SETTLE_MS;
+    tuningApply(&tuning);
+  }
+  schedAfter(&tuneTimer, TUNE_WINDOW_MS);
+}
+#endif
+
+static void powerStart()
+{
+  schedTimerInit(&powerTimer, powerCheck, NULL);
+  schedTimerInit(&shutdownTimer, shutdownNext, NULL);
+#if CAMERA_AUTO_TUNE
+  schedTimerInit(&tuneTimer, tuneCheck, NULL);
+  tunerInit(&tuning);
+  tuningApply(&tuning);
+  schedAfter(&tuneTimer, TUNE_WINDOW_MS);
+#endif
+  schedAt(&powerTimer, lastSeenQrMs + POWER_IDLE_AFTER_MS);
+}
+
+// ---------------------- LCD TASK ----------------------
+// Sleeps until a task changes the display text, then writes only what changed
+void lcdTask(void *pvParameters)
+{
+  while (true)
+  {
+    displayRender(HAL_WAIT_FOREVER);
+  }
+}
+
+// ---------------------- VALIDATION WORKERS ----------------------
+// Asks the server about url. Returns 1 for a grant, 0 for a definitive deny
+// (a 200 that parses as not granted, 401, 403 or 404) and -1 when there is
+// no verdict: unreachable, 5xx, 408/429 or any other answer. Only a
+// definitive deny revokes the cached grant, so an outage behind a proxy that
+// answers 502/503 leaves the offline cache alone. *grant gets the server's
+// unlock time, text and cache TTL (defaults unless it sent them).
+static int validateUrl(HalHttpClient *client, const char *url, uint8_t *arena, uint32_t timeoutMs,
+                       GrantResponse *grant)
+{
+  memset(grant, 0, sizeof(GrantResponse));
+
+  // Scans decoded while WiFi is still joining after a wake wait here; a
+  // shorter request doesn't wait longer for WiFi than for the server
+  if (!halNetworkWait(timeoutMs < HTTP_TIMEOUT_MS ? timeoutMs : NETWORK_WAIT_MS))
+  {
+    halLog("HTTP: network not up\n");
+    return -1;
+  }
+
+  char body[GRANT_BODY_BYTES];
+  uint64_t httpStartUs = halMicros();
+  int httpCode = halHttpGet(client, url, body, sizeof(body), timeoutMs);
+  uint64_t httpEndUs = halMicros();
+  latencyRecord(LAT_HTTP, httpStartUs, httpEndUs);
+  metricsObserve(MET_HTTP, httpStartUs, httpEndUs);
+  metricsHttpStatus(httpCode);
+
+  int verdict = 0;
+  if (httpCode == 200)
+  {
+    if (!grantParse(body, strlen(body), arena, GRANT_ARENA_BYTES, grant))
+    {
+      halLog("HTTP 200: Malformed payload\n");
+      verdict = -1;
+    }
+    else if (grant->granted)
+    {
+      verdict = 1;
+    }
+    else
+    {
+      halLog("HTTP 200: Not granted\n");
+    }
+  }
+  else if (httpCode == 401)
+  {
+    halLog("HTTP %d: Unauthorized\n", httpCode);
+  }
+  else if (httpCode == 403)
+  {
+    halLog("HTTP %d: Forbidden\n", httpCode);
+  }
+  else if (httpCode == 404)
+  {
+    halLog("HTTP %d: Not Found\n", httpCode);
+  }
+  else if (httpCode >= 500 || httpCode == 408 || httpCode == 429)
+  {
+    halLog("HTTP %d: Server unavailable\n", httpCode);
+    verdict = -1;
+  }
+  else if (httpCode != 0)
+  {
+    halLog("HTTP %d: Unexpected response\n", httpCode);
+    verdict = -1;
+  }
+  else
+  {
+    verdict = -1;
+  }
+
+  // Keep the local cache in line with the server, including revocations
+  if (verdict == 1)
+    accessRecordGrant(url, grant->cacheTtlS, grant->unlockMs);
+  else if (verdict == 0)
+    accessRecordDeny(url);
+  return verdict;
+}
+
+static void postResult(const UrlMessage &urlMsg, bool granted, uint32_t unlockMs, const char *text)
+{
+  ScanResult result = {urlMsg.scanId, granted, unlockMs, "", urlMsg.frameUs, halMicros(), urlMsg.payloadHash};
+  strcpy(result.text, text);
+  halQueueSend(resultQueue, &result, HAL_WAIT_FOREVER);
+}
+
+// VALIDATION_WORKERS of these run concurrently, each with its own keep-alive
+// connection, so one slow response doesn't hold up the scans queued behind it
+void validationTask(void *pvParameters)
+{
+  int worker = (int)(intptr_t)pvParameters;
+  HalHttpClient *client = halHttpClientCreate();
+  UrlMessage urlMsg;
+  char lastUrl[QR_PAYLOAD_LEN] = "";
+  while (true)
+  {
+    if (!halQueueReceive(urlQueue, &urlMsg, HTTP_KEEPALIVE_CHECK_MS))
+    {
+      // Idle: re-open the validation connection if it dropped, so the next
+      // scan doesn't pay for the TCP/TLS handshake
+      if (lastUrl[0] != '\0')
+        halHttpWarmup(client, lastUrl);
+      accessPersist();
+      if (worker == 0)
+        auditService();
+      continue;
+    }
+
+    const char *url = urlSlots[urlMsg.slot];
+    strcpy(lastUrl, url);
+    latencyRecord(LAT_URL_QUEUE, urlMsg.enqueuedUs, halMicros());
+    halLog("HTTP[%d]: processing scan #%lu -> %s\n", worker, (unsigned long)urlMsg.scanId, url);
+
+    GrantResponse grant;
+    uint32_t cachedUnlockMs;
+    AccessDecision local = accessCheckLocal(url, &cachedUnlockMs);
+    if (local != ACCESS_UNKNOWN)
+    {
+      // Decided locally: open immediately, then tell the server for audit.
+      // The door is already open, so a slow or down server only gets
+      // HTTP_AUDIT_TIMEOUT_MS of this worker, not HTTP_TIMEOUT_MS.
+      halLog("ACCESS: %s grant\n", local == ACCESS_GRANT_SIGNED ? "signed" : "cached");
+      postResult(urlMsg, true, cachedUnlockMs, "");
+      recentScanDecided(urlMsg.payloadHash, RECENT_GRANTED, halMillis());
+      auditRecord(url, local == ACCESS_GRANT_SIGNED ? AUDIT_GRANTED_SIGNED : AUDIT_GRANTED_CACHED, urlMsg.frameUs);
+      if (validateUrl(client, url, grantArenas[worker], HTTP_AUDIT_TIMEOUT_MS, &grant) < 0)
+        halLog("ACCESS: audit request failed\n");
+    }
+    else
+    {
+      // LCD feedback
+      displayShow(1, "processing...");
+
+      int verdict = validateUrl(client, url, grantArenas[worker], HTTP_TIMEOUT_MS, &grant);
+      postResult(urlMsg, verdict == 1, grant.unlockMs, grant.text);
+      if (verdict >= 0)
+        recentScanDecided(urlMsg.payloadHash, verdict == 1 ? RECENT_GRANTED : RECENT_DENIED, halMillis());
+      auditRecord(url, verdict == 1 ? AUDIT_GRANTED : verdict == 0 ? AUDIT_DENIED : AUDIT_UNREACHABLE, urlMsg.frameUs);
+    }
+    halQueueSend(urlSlotFree, &urlMsg.slot, 0);
+  }
+}
+
+// ---------------------- RESULT TASK ----------------------
+static void showResult(const ScanResult &result)
+{
+  if (result.granted)
+  {
+    displayShow(1, result.text[0] ? result.text : "ACCESS GRANTED", true);
+    unlockLock(result.unlockMs); // open first, the jingle plays asynchronously
+    uint64_t unlockedUs = halMicros();
+    latencyRecord(LAT_ACTUATE, result.decidedUs, unlockedUs);
+    latencyRecord(LAT_SCAN_TO_UNLOCK, result.frameUs, unlockedUs);
+    metricsObserve(MET_SCAN_TO_UNLOCK, result.frameUs, unlockedUs);
+    beepSuccess();
+  }
+  else
+  {
+    displayShow(1, result.text[0] ? result.text : "ACCESS DENIED", true);
+    beepFail();
+  }
+}
+
+// What the display shows. Scanning stays armed in every state; a code held
+// in front of the camera is kept from re-validating by the payload debounce.
+enum DisplayState
+{
+  DISPLAY_PROMPT, // waiting for a code
+  DISPLAY_RESULT, // ACCESS GRANTED/DENIED for RESULT_DISPLAY_MS
+  DISPLAY_BUSY    // result shown long enough, later scans still in flight
+};
+
+// Written by resultTask only. Line 1 belongs to resultTask until it is back
+// at the prompt, so qrCodeTask doesn't clear a result it hasn't seen.
+static volatile DisplayState displayState = DISPLAY_PROMPT;
+
+// Acts on results as they arrive, in completion order, and returns the
+// display to the prompt once a result has been visible for
+// RESULT_DISPLAY_MS and no scan is in flight.
+void resultTask(void *pvParameters)
+{
+  ScanResult result;
+  uint32_t shownMs = 0;
+  while (true)
+  {
+    uint32_t waitMs = HAL_WAIT_FOREVER;
+    if (displayState == DISPLAY_RESULT)
+    {
+      uint32_t visibleMs = halMillis() - shownMs;
+      waitMs = visibleMs >= RESULT_DISPLAY_MS ? 0 : RESULT_DISPLAY_MS - visibleMs;
+    }
+
+    if (halQueueReceive(resultQueue, &result, waitMs))
+    {
+      scansDone++;
+      halLog("RESULT: scan #%lu %s\n", (unsigned long)result.scanId, result.granted ? "granted" : "denied");
+      displayState = DISPLAY_RESULT; // before the text, so it is never cleared
+      showResult(result);
+
+      // The code that was just handled is likely still in front of the
+      // camera: its debounce runs from now, not from when it was queued.
+      // Other payloads already decoded are still scanned.
+      recentScanAccepted(result.payloadHash, halMillis());
+      shownMs = halMillis();
+    }
+    else if (scansDone != scansQueued)
+    {
+      // The next result redraws the display when it arrives
+      displayState = DISPLAY_BUSY;
+    }
+    else
+    {
+      displayState = DISPLAY_PROMPT;
+      halLog("RESULT: ready for next scan.\n");
+
+      // Prompt
+      beepStartup();
+      displayShow(0, PROMPT_TEXT, true);
+    }
+  }
+}
+
+// ---------------------- QR TASK ----------------------
+// Hands resultTask a deny for a payload the server refused within
+// RECENT_DENY_MS, as if a worker had decided it. Returns false if the result
+// queue is full, in which case the scan is validated as usual.
+static bool denyRecent(const QrScan &scan, uint64_t payloadHash, uint32_t now)
+{
+  ScanResult result = {scansQueued + 1, false, 0, "", scan.frameUs, halMicros(), payloadHash};
+  if (!halQueueSend(resultQueue, &result, 0))
+    return false;
+  scansQueued = result.scanId;
+  recentScanAccepted(payloadHash, now);
+  halLog("QR: #%lu denied moments ago, not re-sent -> %s\n", (unsigned long)result.scanId, scan.payload);
+  metricsCount(MET_SCANS_DENIED_RECENT);
+  auditRecord(scan.payload, AUDIT_DENIED_RECENT, scan.frameUs);
+  return true;
+}
+
+void qrCodeTask(void *pvParameters)
+{
+  QrScan qrCodeData;
+  bool statusShown = false; // line 1 shows "scanning..." and needs clearing
+  while (true)
+  {
+    // Wake as soon as the decoder queues a result; only time out to clear
+    // the status line NO_QR_CLEAR_DELAY after the last detection
+    uint32_t waitMs = HAL_WAIT_FOREVER;
+    if (statusShown)
+    {
+      unsigned long sinceSeenMs = halMillis() - lastSeenQrMs;
+      waitMs = sinceSeenMs > NO_QR_CLEAR_DELAY ? 0 : NO_QR_CLEAR_DELAY + 1 - sinceSeenMs;
+    }
+
+    if (halCameraReceiveQr(&qrCodeData, waitMs))
+    {
+      uint64_t beepStartUs = halMicros();
+      latencyRecord(LAT_RESULT_HANDOFF, qrCodeData.frameUs, beepStartUs);
+      unsigned long now = halMillis();
+      lastSeenQrMs = now;
+      powerActivity(now);
+
+      // ---------- Debounce check (valid + invalid) ----------
+      // Scanning stays armed while results are validated and shown, so a
+      // code held in front of the camera arrives every frame; repeats are
+      // ignored silently. Every payload accepted recently is debounced, so
+      // people taking turns at the reader don't re-validate each other.
+      uint64_t payloadHash = 0;
+      RecentScan recent;
+      bool known = false;
+      if (qrCodeData.valid)
+      {
+        payloadHash = recentScanHash(qrCodeData.payload);
+        known = recentScanFind(payloadHash, &recent);
+        if (known && now - recent.acceptedMs < QR_DEBOUNCE_MS)
+        {
+          metricsCount(MET_SCANS_DEBOUNCED);
+          continue;
+        }
+      }
+      else
+      {
+        if (now - lastInvalidMs < INVALID_DEBOUNCE_MS)
+        {
+          metricsCount(MET_SCANS_DEBOUNCED);
+          continue;
+        }
+      }
+
+      displayShow(1, "scanning...");
+      statusShown = true;
+      beepDetect();
+      latencyRecord(LAT_BEEP_DETECT, beepStartUs, halMicros());
+      if (qrCodeData.valid)
+      {
+        beepStartUs = halMicros();
+        beepProcess();
+        latencyRecord(LAT_BEEP_PROCESS, beepStartUs, halMicros());
+      }
+
+      // ---------- Handle QR after debounce ----------
+      if (qrCodeData.valid)
+      {
+        const char *payload = qrCodeData.payload;
+
+        // Refused moments ago: answer without another round trip
+        bool deniedRecently = known && recent.outcome == RECENT_DENIED && now - recent.decidedMs < RECENT_DENY_MS;
+        if (deniedRecently && denyRecent(qrCodeData, payloadHash, now))
+          continue;
+
+        // Every slot taken means the queue is full and every worker busy
+        UrlMessage urlMsg;
+        bool queued = halQueueReceive(urlSlotFree, &urlMsg.slot, ENQUEUE_TIMEOUT_MS);
+        if (queued)
+        {
+          urlMsg.scanId = scansQueued + 1;
+          urlMsg.payloadHash = payloadHash;
+          snprintf(urlSlots[urlMsg.slot], QR_PAYLOAD_LEN, "%s", payload);
+          urlMsg.frameUs = qrCodeData.frameUs;
+          urlMsg.enqueuedUs = halMicros();
+          queued = halQueueSend(urlQueue, &urlMsg, 0);
+          if (!queued)
+            halQueueSend(urlSlotFree, &urlMsg.slot, 0);
+        }
+
+        if (!queued)
+        {
+          halLog("QR: validation queue full, scan dropped.\n");
+          metricsCount(MET_URL_QUEUE_DROPS);
+        }
+        else
+        {
+          scansQueued = urlMsg.scanId;
+          recentScanAccepted(payloadHash, now);
+
+          halLog("QR: accepted #%lu -> %s\n", (unsigned long)urlMsg.scanId, payload);
+        }
+      }
+      else
+      {
+        halLog("QR: invalid QR.\n");
+        lastInvalidMs = now;
+      }
+    }
+    else if (statusShown)
+    {
+      // -------- No QR detected → clear LCD line --------
+      // unless a result is showing there; the prompt clears it later
+      if (displayState == DISPLAY_PROMPT)
+        displayShow(1, "");
+      statusShown = false;
+    }
+  }
+}
+
+// ---------------------- BUTTON RESTART ----------------------
+// The press interrupts; the restart follows RESTART_DEBOUNCE_MS later on the
+// scheduler task, so the contacts' bounce has nothing left to trigger
+static SchedTimer restartTimer;
+static int buttonSignal = -1;
+
+static void HAL_ISR_ATTR buttonIsr()
+{
+  schedRaiseFromIsr(buttonSignal);
+}
+
+static void buttonPressed(void *arg)
+{
+  if (!schedArmed(&restartTimer))
+    schedAfter(&restartTimer, RESTART_DEBOUNCE_MS);
+}
+
+static void restartNow(void *arg)
+{
+  auditFlush();
+  halRestart();
+}
+
+// ---------------------- LOCK MANAGEMENT ----------------------
+// One-shot timer, due exactly when the unlock ends. lockMutex keeps the
+// relock's check and write from interleaving with a new unlock.
+static SchedTimer relockTimer;
+static HalMutex lockMutex;
+
+static void relock(void *arg)
+{
+  halMutexLock(lockMutex);
+  bool relocked = !schedArmed(&relockTimer); // armed again: unlocked while this was on its way
+  if (relocked)
+  {
+    halLockWrite(false);
+    isUnlocked = false;
+  }
+  halMutexUnlock(lockMutex);
+  if (relocked)
+    halLog("Lock: relocked automatically\n");
+}
+
+// Function to unlock the lock and set the timer to relock
+void unlockLock(uint32_t durationMs)
+{
+  halMutexLock(lockMutex);
+  halLockWrite(true);
+  isUnlocked = true;
+  schedAfter(&relockTimer, durationMs ? durationMs : LOCK_UNLOCK_DURATION_MS);
+  halMutexUnlock(lockMutex);
+}
+
+// ---------------------- START ----------------------
+bool appStart()
+{
+  urlQueue = halQueueCreate(URL_QUEUE_DEPTH, sizeof(UrlMessage));
+  resultQueue = halQueueCreate(URL_QUEUE_DEPTH + VALIDATION_WORKERS, sizeof(ScanResult));
+  urlSlotFree = halQueueCreate(URL_SLOTS, sizeof(uint8_t));
+
+  if (!urlQueue || !resultQueue || !urlSlotFree || !displayInit())
+  {
+    halLog("ERROR: queue creation failed\n");
+    return false;
+  }
+  for (uint8_t slot = 0; slot < URL_SLOTS; slot++)
+    halQueueSend(urlSlotFree, &slot, 0);
+
+  if (!recentScanInit())
+  {
+    halLog("ERROR: recent-scan table creation failed\n");
+    return false;
+  }
+  if (!accessInit())
+  {
+    halLog("ERROR: access cache allocation failed\n");
+    return false;
+  }
+  if (!auditInit())
+  {
+    halLog("ERROR: audit log allocation failed\n");
+    return false;
+  }
+
+  // Initialize last seen time
+  lastSeenQrMs = halMillis();
+
+  // Timers and the button's signal, all served by one scheduler task
+  lockMutex = halMutexCreate();
+  if (!lockMutex || !schedulerInit())
+  {
+    halLog("ERROR: scheduler/lock mutex creation failed\n");
+    return false;
+  }
+  schedTimerInit(&relockTimer, relock, NULL);
+  schedTimerInit(&restartTimer, restartNow, NULL);
+  buttonSignal = schedSignalCreate(buttonPressed, NULL);
+  halButtonOnPress(buttonIsr);
+  powerStart();
+
+  // Tasks pinned to Core 1 (application logic)
+  bool ok = true;
+  ok &= schedulerStart(4 * 1024, 5, 1);
+  ok &= halTaskCreate(qrCodeTask, "QR_Task", 10 * 1024, NULL, 6, 1);
+  for (int worker = 0; worker < VALIDATION_WORKERS; worker++)
+  {
+    char name[16];
+    snprintf(name, sizeof(name), "HTTP_Task_%d", worker);
+    ok &= halTaskCreate(validationTask, name, 12 * 1024, (void *)(intptr_t)worker, 4, 1);
+  }
+  ok &= halTaskCreate(resultTask, "Result_Task", 4 * 1024, NULL, 4, 1);
+  ok &= halTaskCreate(lcdTask, "LCD_Task", 6 * 1024, NULL, 3, 1);
+  ok &= profilerStart();
+  return ok;
+}
+
+void appReady()
+{
+  halLog("Ready for scans %lu ms after boot\n", (unsigned long)halMillis());
+
+  // Prompt
+  beepStartup();
+  displayShow(0, PROMPT_TEXT, true);
+}
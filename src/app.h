@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+// Scan pipeline: qrCodeTask -> urlQueue -> VALIDATION_WORKERS validation
+// tasks -> resultQueue -> resultTask, plus the LCD task (display.h). The
+// relock, the restart button and the power tiers are timers on the
+// scheduler task (scheduler.h). Hardware access goes through hal.h, lcd.h
+// and buzzer.h so this runs on device and host.
+
+// Creates the queues and starts all application tasks. Returns false if a
+// queue or task could not be created.
+bool appStart();
+
+// Shows the scan prompt once everything is initialized.
+void appReady();
+
+// Function to unlock the lock and set the timer to relock
+void unlockLock(uint32_t durationMs); // 0 = LOCK_UNLOCK_DURATION_MS
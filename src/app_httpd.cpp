@@ -1,7 +1,14 @@
 #include <Arduino.h>
 #include "esp_http_server.h"
-#include "esp_camera.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "lwip/sockets.h"
+#include "app_httpd.h"
+#include "config.h"
+#include "frame_ring.h"
+#include "hal.h"
+#include "metrics.h"
+#include "profiler.h"
 
 static const char* TAG = "camera_httpd";
 
@@ -37,86 +44,471 @@ static esp_err_t index_handler(httpd_req_t *req) {
     return httpd_resp_send(req, INDEX_HTML, HTTPD_RESP_USE_STRLEN);
 }
 
-static esp_err_t stream_handler(httpd_req_t *req) {
-    camera_fb_t * fb = NULL;
-    esp_err_t res = ESP_OK;
-    size_t _jpg_buf_len = 0;
-    uint8_t * _jpg_buf = NULL;
-    char * part_buf[128];
-
-    static const char* _STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=frame";
-    static const char* _STREAM_BOUNDARY = "\r\n--frame\r\n";
-    static const char* _STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %d.%06d\r\n\r\n";
-
-    ESP_LOGI(TAG, "Starting stream...");
-    
-    res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
-    if(res != ESP_OK) {
-        return res;
-    }
-
-    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-    httpd_resp_set_hdr(req, "X-Framerate", "60");
-    
-    while(true) {
-        fb = esp_camera_fb_get();
-        if (!fb) {
-            ESP_LOGE(TAG, "Camera capture failed");
-            res = ESP_FAIL;
-        } else {
-            struct timeval _timestamp;
-            gettimeofday(&_timestamp, NULL);
-
-            if(fb->width > 400){
-                if(fb->format != PIXFORMAT_JPEG){
-                    bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
-                    esp_camera_fb_return(fb);
-                    fb = NULL;
-                    if(!jpeg_converted){
-                        ESP_LOGE(TAG, "JPEG compression failed");
-                        res = ESP_FAIL;
-                    }
-                } else {
-                    _jpg_buf_len = fb->len;
-                    _jpg_buf = fb->buf;
+// ---------------------- METRICS ----------------------
+#define METRICS_PAGE_BYTES 6144 // room for every counter and histogram line
+
+static esp_err_t metrics_handler(httpd_req_t *req) {
+    char *page = (char *)malloc(METRICS_PAGE_BYTES);
+    if (!page) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    size_t len = metricsFormat(page, METRICS_PAGE_BYTES);
+    esp_err_t res;
+    if (len == 0) {
+        ESP_LOGE(TAG, "Metrics page overflow");
+        res = httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Metrics page overflow");
+    } else {
+        httpd_resp_set_type(req, "text/plain; version=0.0.4");
+        res = httpd_resp_send(req, page, len);
+    }
+    free(page);
+    return res;
+}
+
+static esp_err_t profile_handler(httpd_req_t *req) {
+    char *page = (char *)malloc(METRICS_PAGE_BYTES);
+    if (!page) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    size_t len = profilerFormat(page, METRICS_PAGE_BYTES);
+    httpd_resp_set_type(req, "text/plain");
+    esp_err_t res = len ? httpd_resp_send(req, page, len) : httpd_resp_send(req, "no profile yet\n", HTTPD_RESP_USE_STRLEN);
+    free(page);
+    return res;
+}
+
+// ---------------------- CAPTURE ----------------------
+// /capture returns the newest camera frame as a binary PGM, exactly as the
+// decoder sees it, for recording real frames into the replay corpus. The
+// pixels are copied out so a slow download doesn't keep the framebuffer
+// from the decoder.
+static esp_err_t capture_handler(httpd_req_t *req) {
+    static int subscriber = -1; // handlers run one at a time on the httpd task
+    if (subscriber < 0) {
+        subscriber = frameRingSubscribe();
+    }
+    FrameRef *ref = subscriber >= 0 ? frameRingAcquire(subscriber, 0, 1000) : NULL;
+    if (!ref) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "No frame (is the reader in standby?)", HTTPD_RESP_USE_STRLEN);
+    }
+
+    const HalFrame *frame = frameRingFrame(ref);
+    char header[32];
+    size_t headerLen = snprintf(header, sizeof(header), "P5\n%u %u\n255\n", frame->width, frame->height);
+    size_t len = headerLen + frame->len;
+    uint8_t *pgm = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (pgm) {
+        memcpy(pgm, header, headerLen);
+        memcpy(pgm + headerLen, frame->buf, frame->len);
+    }
+    frameRingRelease(ref);
+    if (!pgm) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "image/x-portable-graymap");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=capture.pgm");
+    esp_err_t res = httpd_resp_send(req, (const char *)pgm, len);
+    free(pgm);
+    return res;
+}
+
+// ---------------------- STREAM ----------------------
+// /stream only registers the client and returns, so it never ties up an
+// httpd worker. One low-priority task on core 1 (the decoder runs on core 0)
+// takes frames from the ring and pushes them to every viewer with
+// non-blocking sends. A viewer whose socket is still draining the previous
+// frame skips new ones until it catches up; it never stalls the others.
+//
+// streamMutex is only held to mark the viewers of a pass busy and to settle
+// them afterwards, never across an encode or a send. A busy slot belongs to
+// streamTask alone: /stream never takes it, and a session closed meanwhile
+// is only flagged, so its socket stays open until streamTask is done with it.
+
+// One frame's JPEG, shared by every viewer sending it. The stream keeps its
+// own copy of the ring's JPEG rather than holding the ring reference, so a
+// slow viewer never pins a camera framebuffer the decoder is waiting for.
+struct StreamJpeg {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    uint32_t seq;         // ring frame, 0 = empty
+    int quality;
+    uint8_t scale;
+};
+
+struct StreamClient {
+    int fd;               // -1 when the slot is free
+    bool busy;            // in streamTask's current pass
+    bool closed;          // httpd closed the session during the pass
+    bool failed;          // a send failed during the pass
+    uint32_t intervalMs;  // from ?fps=
+    uint32_t nextFrameMs;
+    int quality;          // from ?quality=
+    int maxWidth;         // from ?width=, 0 = full frame
+    uint8_t scale;        // 1, 2 or 4, the last frame's downscale for maxWidth
+    char part[128];       // multipart header of the frame being sent
+    size_t partLen;
+    StreamJpeg *jpeg;     // frame being sent after part
+    size_t len;           // partLen + JPEG length
+    size_t sent;
+    uint32_t framesSent;
+    uint32_t framesSkipped;
+};
+
+static StreamClient streamClients[STREAM_MAX_VIEWERS];
+static StreamJpeg streamJpegs[STREAM_MAX_VIEWERS]; // a viewer mid-send holds at most one
+static int streamViewers = 0;
+static HalMutex streamMutex;  // guards slot ownership against /stream and httpd closing sockets
+static HalEvent streamWake;   // a viewer connected
+static uint8_t *scaledBuf = NULL; // downscaled frame for ?width= viewers
+static size_t scaledCap = 0;
+
+static const char* _STREAM_HEADER = "HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace;boundary=frame\r\n"
+                                    "Access-Control-Allow-Origin: *\r\nX-Framerate: %u\r\n\r\n";
+static const char* _STREAM_PART = "\r\n--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %u.%06u\r\n\r\n";
+
+static bool reserve(uint8_t **buf, size_t *cap, size_t len) {
+    if (len <= *cap) {
+        return true;
+    }
+    uint8_t *grown = (uint8_t *)heap_caps_realloc(*buf, len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!grown) {
+        return false;
+    }
+    *buf = grown;
+    *cap = len;
+    return true;
+}
+
+// Box-filters a grayscale frame down by scale into scaledBuf
+static bool downscale(const HalFrame *frame, uint8_t scale, HalFrame *out) {
+    uint16_t w = frame->width / scale;
+    uint16_t h = frame->height / scale;
+    if (!reserve(&scaledBuf, &scaledCap, (size_t)w * h)) {
+        return false;
+    }
+    for (uint16_t y = 0; y < h; y++) {
+        for (uint16_t x = 0; x < w; x++) {
+            uint32_t sum = 0;
+            for (uint8_t dy = 0; dy < scale; dy++) {
+                const uint8_t *row = frame->buf + (size_t)(y * scale + dy) * frame->width + x * scale;
+                for (uint8_t dx = 0; dx < scale; dx++) {
+                    sum += row[dx];
                 }
             }
+            scaledBuf[(size_t)y * w + x] = sum / (scale * scale);
+        }
+    }
+    *out = *frame;
+    out->buf = scaledBuf;
+    out->len = (size_t)w * h;
+    out->width = w;
+    out->height = h;
+    out->priv = NULL;
+    return true;
+}
 
-            if(res == ESP_OK){
-                res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
+// True while a viewer of this pass still has bytes of jpeg to send. Viewers
+// outside the pass are either new or closed and never resume an old frame.
+static bool jpegInUse(const StreamJpeg *jpeg) {
+    for (int i = 0; i < STREAM_MAX_VIEWERS; i++) {
+        const StreamClient *client = &streamClients[i];
+        if (client->busy && client->jpeg == jpeg && client->sent < client->len) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the JPEG of the ring frame at the given settings, encoding it (or
+// copying the ring's default encode) only if no viewer has it already
+static StreamJpeg *frameJpeg(FrameRef *ref, int quality, uint8_t scale) {
+    StreamJpeg *jpeg = NULL;
+    for (int i = 0; i < STREAM_MAX_VIEWERS; i++) {
+        StreamJpeg *candidate = &streamJpegs[i];
+        if (candidate->seq == frameRingSeq(ref) && candidate->quality == quality && candidate->scale == scale) {
+            return candidate;
+        }
+        if (!jpeg && !jpegInUse(candidate)) {
+            jpeg = candidate;
+        }
+    }
+    if (!jpeg) {
+        return NULL;
+    }
+    jpeg->seq = 0;
+
+    if (quality == STREAM_JPEG_QUALITY && scale == 1) {
+        const uint8_t *ringJpeg;
+        size_t ringLen;
+        if (!frameRingJpeg(ref, &ringJpeg, &ringLen) || !reserve(&jpeg->buf, &jpeg->cap, ringLen)) {
+            return NULL;
+        }
+        memcpy(jpeg->buf, ringJpeg, ringLen);
+        jpeg->len = ringLen;
+    } else {
+        HalFrame scaled;
+        const HalFrame *source = frameRingFrame(ref);
+        if (scale > 1) {
+            if (!downscale(source, scale, &scaled)) {
+                return NULL;
             }
-            if(res == ESP_OK){
-                size_t hlen = snprintf((char *)part_buf, 128, _STREAM_PART, _jpg_buf_len, _timestamp.tv_sec, _timestamp.tv_usec);
-                res = httpd_resp_send_chunk(req, (const char *)part_buf, hlen);
+            source = &scaled;
+        }
+        uint8_t *encoded = NULL;
+        size_t encodedLen = 0;
+        if (!halCameraEncodeJpeg(source, quality, &encoded, &encodedLen)) {
+            return NULL;
+        }
+        free(jpeg->buf); // take the encoder's buffer instead of copying it
+        jpeg->buf = encoded;
+        jpeg->cap = encodedLen;
+        jpeg->len = encodedLen;
+    }
+    jpeg->seq = frameRingSeq(ref);
+    jpeg->quality = quality;
+    jpeg->scale = scale;
+    return jpeg;
+}
+
+// Points the client at the next multipart part
+static bool queueFrame(StreamClient *client, FrameRef *ref) {
+    uint16_t width = frameRingFrame(ref)->width;
+    client->scale = 1;
+    while (client->maxWidth > 0 && width / client->scale > client->maxWidth && client->scale < 4) {
+        client->scale *= 2;
+    }
+
+    StreamJpeg *jpeg = frameJpeg(ref, client->quality, client->scale);
+    if (!jpeg) {
+        return false;
+    }
+    uint64_t timestampUs = frameRingFrame(ref)->timestampUs;
+    client->partLen = snprintf(client->part, sizeof(client->part), _STREAM_PART, (unsigned)jpeg->len,
+                               (unsigned)(timestampUs / 1000000), (unsigned)(timestampUs % 1000000));
+    client->jpeg = jpeg;
+    client->len = client->partLen + jpeg->len;
+    client->sent = 0;
+    return true;
+}
+
+static void forgetClient(StreamClient *client) {
+    ESP_LOGI(TAG, "Stream ended: %u frames sent, %u skipped", client->framesSent, client->framesSkipped);
+    client->fd = -1;
+    streamViewers--;
+}
+
+// Drops a viewer whose socket failed; httpd closes it
+static void dropClient(StreamClient *client) {
+    httpd_sess_trigger_close(stream_httpd, client->fd);
+    forgetClient(client);
+}
+
+// Sends as much of each pending part as the socket takes without blocking,
+// the header from the client and the JPEG straight from the shared buffer.
+// Returns true while some viewer still has bytes queued.
+static bool flushClients() {
+    bool pending = false;
+    for (int i = 0; i < STREAM_MAX_VIEWERS; i++) {
+        StreamClient *client = &streamClients[i];
+        while (client->busy && !client->failed && client->sent < client->len) {
+            const uint8_t *from = client->sent < client->partLen
+                                      ? (const uint8_t *)client->part + client->sent
+                                      : client->jpeg->buf + (client->sent - client->partLen);
+            size_t size = client->sent < client->partLen ? client->partLen - client->sent : client->len - client->sent;
+            int n = send(client->fd, from, size, MSG_DONTWAIT);
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                client->failed = true; // dropped when the pass is settled
+                break;
             }
-            if(res == ESP_OK){
-                res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
+            if (n <= 0) {
+                break;
             }
-            if(fb){
-                esp_camera_fb_return(fb);
-                fb = NULL;
-                _jpg_buf = NULL;
-            } else if(_jpg_buf){
-                free(_jpg_buf);
-                _jpg_buf = NULL;
+            client->sent += n;
+            if (client->sent == client->len) {
+                client->framesSent++;
             }
-            if(res != ESP_OK){
-                ESP_LOGE(TAG, "Send frame failed");
-                break;
+        }
+        pending |= client->busy && !client->failed && client->sent < client->len;
+    }
+    return pending;
+}
+
+static void streamTask(void *arg) {
+    int subscriber = frameRingSubscribe();
+    if (subscriber < 0) {
+        ESP_LOGE(TAG, "No frame ring subscriber left for the stream");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    uint32_t lastSeq = 0;
+    bool pending = false;
+    while (true) {
+        halMutexLock(streamMutex);
+        int viewers = streamViewers;
+        halMutexUnlock(streamMutex);
+        if (viewers == 0) {
+            halEventWait(streamWake, HAL_WAIT_FOREVER);
+            continue;
+        }
+
+        // While a socket is backed up, come back soon to flush it even if
+        // no new frame arrives
+        FrameRef *ref = frameRingAcquire(subscriber, lastSeq, pending ? STREAM_FLUSH_POLL_MS : 1000);
+
+        halMutexLock(streamMutex);
+        for (int i = 0; i < STREAM_MAX_VIEWERS; i++) {
+            streamClients[i].busy = streamClients[i].fd >= 0;
+        }
+        halMutexUnlock(streamMutex);
+
+        if (ref) {
+            lastSeq = frameRingSeq(ref);
+            uint32_t now = millis();
+            for (int i = 0; i < STREAM_MAX_VIEWERS; i++) {
+                StreamClient *client = &streamClients[i];
+                if (!client->busy || client->failed || (int32_t)(now - client->nextFrameMs) < 0) {
+                    continue;
+                }
+                if (client->sent < client->len) {
+                    client->framesSkipped++; // still sending the last frame
+                    continue;
+                }
+                client->nextFrameMs = now + client->intervalMs;
+                if (!queueFrame(client, ref)) {
+                    ESP_LOGE(TAG, "JPEG compression failed");
+                }
             }
-            int64_t fr_end = esp_timer_get_time();
+            frameRingRelease(ref);
         }
+        pending = flushClients();
+
+        halMutexLock(streamMutex);
+        for (int i = 0; i < STREAM_MAX_VIEWERS; i++) {
+            StreamClient *client = &streamClients[i];
+            if (!client->busy) {
+                continue;
+            }
+            client->busy = false;
+            if (client->closed) {
+                int fd = client->fd;
+                forgetClient(client);
+                close(fd);
+            } else if (client->failed) {
+                dropClient(client);
+            }
+        }
+        halMutexUnlock(streamMutex);
     }
+}
 
-    ESP_LOGI(TAG, "Stream ended");
-    return res;
+// httpd's close_fn: forget a viewer whose session is closing, then close it.
+// A viewer in streamTask's pass is closed by streamTask when the pass ends.
+static void streamSessionClosed(httpd_handle_t hd, int sockfd) {
+    bool deferred = false;
+    halMutexLock(streamMutex);
+    for (int i = 0; i < STREAM_MAX_VIEWERS; i++) {
+        StreamClient *client = &streamClients[i];
+        if (client->fd != sockfd) {
+            continue;
+        }
+        if (client->busy) {
+            client->closed = true;
+            deferred = true;
+        } else {
+            forgetClient(client);
+        }
+    }
+    halMutexUnlock(streamMutex);
+    if (!deferred) {
+        close(sockfd);
+    }
+}
+
+static int queryInt(const char *query, const char *key, int fallback, int lo, int hi) {
+    char value[16];
+    if (!query || httpd_query_key_value(query, key, value, sizeof(value)) != ESP_OK) {
+        return fallback;
+    }
+    int v = atoi(value);
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+// /stream[?fps=N][&quality=1-100][&width=W]
+static esp_err_t stream_handler(httpd_req_t *req) {
+    char query[64];
+    const char *q = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK ? query : NULL;
+    int fps = queryInt(q, "fps", STREAM_MAX_FPS, 1, STREAM_MAX_FPS);
+    int quality = queryInt(q, "quality", STREAM_JPEG_QUALITY, 1, 100);
+    int width = queryInt(q, "width", 0, 0, 0xFFFF);
+
+    halMutexLock(streamMutex);
+    StreamClient *client = NULL;
+    for (int i = 0; i < STREAM_MAX_VIEWERS && !client; i++) {
+        if (streamClients[i].fd < 0) {
+            client = &streamClients[i];
+        }
+    }
+    if (!client) {
+        halMutexUnlock(streamMutex);
+        ESP_LOGW(TAG, "Too many stream clients");
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "Too many stream clients", HTTPD_RESP_USE_STRLEN);
+    }
+
+    char header[192];
+    int headerLen = snprintf(header, sizeof(header), _STREAM_HEADER, (unsigned)fps);
+    if (httpd_send(req, header, headerLen) != headerLen) {
+        halMutexUnlock(streamMutex);
+        return ESP_FAIL;
+    }
+
+    client->fd = httpd_req_to_sockfd(req);
+    client->busy = false;
+    client->closed = false;
+    client->failed = false;
+    client->intervalMs = 1000 / fps;
+    client->nextFrameMs = millis();
+    client->quality = quality;
+    client->maxWidth = width;
+    client->scale = 1;
+    client->jpeg = NULL;
+    client->len = 0;
+    client->sent = 0;
+    client->framesSent = 0;
+    client->framesSkipped = 0;
+    streamViewers++;
+    halMutexUnlock(streamMutex);
+
+    ESP_LOGI(TAG, "Starting stream: %d fps, quality %d, width <= %d", fps, quality, width);
+    halEventSignal(streamWake);
+    return ESP_OK; // the socket stays open; streamTask owns it from here
 }
 
 void startCameraServer(){
+  for (int i = 0; i < STREAM_MAX_VIEWERS; i++) {
+    streamClients[i].fd = -1;
+  }
+  streamMutex = halMutexCreate();
+  streamWake = halEventCreate();
+  if (!streamMutex || !streamWake ||
+      !halTaskCreate(streamTask, "Stream_Task", 6 * 1024, NULL, 1, 1)) { // lowest priority, off the decode core
+    ESP_LOGE(TAG, "Failed to start stream task");
+    return;
+  }
+
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
   config.server_port = 81;
-  config.stack_size = 8 * 1024; // Increase stack for streaming
+  config.stack_size = 4 * 1024; // handlers only register viewers
   config.lru_purge_enable = true;
+  config.max_open_sockets = STREAM_MAX_VIEWERS + 3; // viewers plus page loads
+  config.close_fn = streamSessionClosed;
 
   httpd_uri_t stream_uri = {
     .uri       = "/stream",
@@ -125,6 +517,27 @@ void startCameraServer(){
     .user_ctx  = NULL
   };
 
+  httpd_uri_t metrics_uri = {
+    .uri       = "/metrics",
+    .method    = HTTP_GET,
+    .handler   = metrics_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t profile_uri = {
+    .uri       = "/profile",
+    .method    = HTTP_GET,
+    .handler   = profile_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t capture_uri = {
+    .uri       = "/capture",
+    .method    = HTTP_GET,
+    .handler   = capture_handler,
+    .user_ctx  = NULL
+  };
+
   httpd_uri_t index_uri = {
     .uri       = "/",
     .method    = HTTP_GET,
@@ -135,6 +548,9 @@ void startCameraServer(){
   if (httpd_start(&stream_httpd, &config) == ESP_OK) {
     httpd_register_uri_handler(stream_httpd, &stream_uri);
     httpd_register_uri_handler(stream_httpd, &index_uri);
+    httpd_register_uri_handler(stream_httpd, &metrics_uri);
+    httpd_register_uri_handler(stream_httpd, &profile_uri);
+    httpd_register_uri_handler(stream_httpd, &capture_uri);
     ESP_LOGI(TAG, "HTTP server started on port %d", config.server_port);
   } else {
     ESP_LOGE(TAG, "Failed to start HTTP server");
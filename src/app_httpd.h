@@ -0,0 +1,5 @@
+#pragma once
+
+// Debug camera server on port 81: the viewer page at / and the MJPEG stream
+// at /stream. Call after halCameraInit().
+void startCameraServer();
@@ -0,0 +1,343 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audit.h"
+#include "config.h"
+#include "hal.h"
+
+// The region is a ring of sectors, each a header slot followed by record
+// slots. Slots fill in order and are never rewritten, so a record's seq
+// follows from its position: slot i of a sector holds firstSeq + i - 1.
+#define AUDIT_MAGIC 0x31445541UL // "AUD1" in flash byte order
+#define AUDIT_RECORD_BYTES 32
+#define AUDIT_SLOTS_PER_SECTOR (HAL_AUDIT_SECTOR_BYTES / AUDIT_RECORD_BYTES)
+#define AUDIT_HASH_LEN 8 // truncated SHA-256 of the payload
+#define AUDIT_SENT_KEY "audit_sent"
+#define AUDIT_UNREADABLE 0xFF // outcome byte for a torn record in an upload
+
+struct AuditEntry
+{
+  uint32_t seq;
+  uint32_t unixTime; // 0 = clock not set yet
+  uint32_t uptimeMs;
+  uint8_t payloadHash[AUDIT_HASH_LEN];
+  uint16_t latencyMs; // frame capture to decision, saturating
+  uint8_t outcome;
+  uint8_t reserved[5]; // left erased
+  uint32_t check;      // FNV-1a of the fields above; a torn write fails it
+};
+
+struct SectorHeader
+{
+  uint32_t magic;
+  uint32_t firstSeq;
+  uint8_t reserved[AUDIT_RECORD_BYTES - 8];
+};
+
+static_assert(sizeof(AuditEntry) == AUDIT_RECORD_BYTES, "a record fills one slot");
+static_assert(sizeof(SectorHeader) == AUDIT_RECORD_BYTES, "a header fills one slot");
+
+static HalMutex auditMutex;
+static size_t sectors = 0;       // 0 = no region, outcomes are only logged
+static uint32_t *sectorFirstSeq; // per sector, 0 = never used
+static size_t headSector = 0;
+static size_t headSlot = 1; // next slot to write in headSector
+static uint32_t nextSeq = 1;
+static AuditEntry batch[AUDIT_BATCH_RECORDS];
+static size_t batchCount = 0;
+static uint32_t batchStartMs = 0;
+static uint32_t sentSeq = 0; // last record the server acknowledged
+
+static const char *const outcomeNames[] = {"denied", "granted", "granted (cached)", "granted (signed)",
+                                           "unreachable", "denied (recent)"};
+
+static size_t slotOffset(size_t sector, size_t slot)
+{
+  return sector * HAL_AUDIT_SECTOR_BYTES + slot * AUDIT_RECORD_BYTES;
+}
+
+static uint32_t entryCheck(const AuditEntry *entry)
+{
+  const uint8_t *bytes = (const uint8_t *)entry;
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < offsetof(AuditEntry, check); i++)
+    hash = (hash ^ bytes[i]) * 16777619UL;
+  return hash;
+}
+
+static bool slotErased(const AuditEntry *entry)
+{
+  const uint8_t *bytes = (const uint8_t *)entry;
+  for (size_t i = 0; i < sizeof(AuditEntry); i++)
+  {
+    if (bytes[i] != 0xFF)
+      return false;
+  }
+  return true;
+}
+
+static uint32_t oldestSeq()
+{
+  uint32_t oldest = nextSeq;
+  for (size_t s = 0; s < sectors; s++)
+  {
+    if (sectorFirstSeq[s] != 0 && sectorFirstSeq[s] < oldest)
+      oldest = sectorFirstSeq[s];
+  }
+  return oldest;
+}
+
+// Erases sector and makes it the head, its first record being firstSeq
+static void startSector(size_t sector, uint32_t firstSeq)
+{
+#ifdef AUDIT_UPLOAD_URL
+  if (sectorFirstSeq[sector] != 0 && sectorFirstSeq[sector] + AUDIT_SLOTS_PER_SECTOR - 2 > sentSeq)
+    halLog("AUDIT: ring full, overwriting records not yet uploaded\n");
+#endif
+
+  SectorHeader header;
+  memset(&header, 0xFF, sizeof(header));
+  header.magic = AUDIT_MAGIC;
+  header.firstSeq = firstSeq;
+  if (!halAuditRegionErase(sector) || !halAuditRegionWrite(slotOffset(sector, 0), &header, sizeof(header)))
+    halLog("AUDIT: sector %u write failed\n", (unsigned)sector);
+  sectorFirstSeq[sector] = firstSeq;
+  headSector = sector;
+  headSlot = 1;
+}
+
+// Appends the RAM batch to the ring, one flash write per sector touched
+static void writeBatch()
+{
+  size_t done = 0;
+  while (done < batchCount)
+  {
+    if (headSlot == AUDIT_SLOTS_PER_SECTOR)
+      startSector((headSector + 1) % sectors, batch[done].seq);
+    size_t n = AUDIT_SLOTS_PER_SECTOR - headSlot;
+    if (n > batchCount - done)
+      n = batchCount - done;
+    if (!halAuditRegionWrite(slotOffset(headSector, headSlot), &batch[done], n * sizeof(AuditEntry)))
+      halLog("AUDIT: flash write failed\n");
+    headSlot += n; // a failed slot stays used so positions keep matching seqs
+    done += n;
+  }
+  batchCount = 0;
+}
+
+bool auditInit()
+{
+  auditMutex = halMutexCreate();
+  if (!auditMutex)
+    return false;
+
+  size_t count = halAuditRegionSize() / HAL_AUDIT_SECTOR_BYTES;
+  if (count < 2)
+  {
+    halLog("AUDIT: no flash region, outcomes are not kept\n");
+    return true;
+  }
+  sectorFirstSeq = (uint32_t *)calloc(count, sizeof(uint32_t));
+  if (!sectorFirstSeq)
+    return false;
+  sectors = count;
+
+  // The head is the sector with the newest header
+  bool found = false;
+  for (size_t s = 0; s < sectors; s++)
+  {
+    SectorHeader header;
+    if (halAuditRegionRead(slotOffset(s, 0), &header, sizeof(header)) && header.magic == AUDIT_MAGIC &&
+        header.firstSeq != 0xFFFFFFFFUL)
+    {
+      sectorFirstSeq[s] = header.firstSeq;
+      if (!found || header.firstSeq > sectorFirstSeq[headSector])
+        headSector = s;
+      found = true;
+    }
+  }
+
+  if (found)
+  {
+    AuditEntry entry;
+    headSlot = 1;
+    while (headSlot < AUDIT_SLOTS_PER_SECTOR &&
+           halAuditRegionRead(slotOffset(headSector, headSlot), &entry, sizeof(entry)) && !slotErased(&entry))
+      headSlot++;
+    nextSeq = sectorFirstSeq[headSector] + headSlot - 1;
+  }
+  else
+  {
+    startSector(0, 1);
+  }
+
+  uint32_t sent;
+  if (halStorageLoad(AUDIT_SENT_KEY, &sent, sizeof(sent)))
+    sentSeq = sent < nextSeq ? sent : nextSeq - 1; // the region may have been wiped
+  halLog("AUDIT: %lu records in flash, %lu not uploaded\n", (unsigned long)(nextSeq - oldestSeq()),
+         (unsigned long)(nextSeq - 1 - sentSeq));
+  return true;
+}
+
+void auditRecord(const char *payload, AuditOutcome outcome, uint64_t frameUs)
+{
+  if (!auditMutex)
+    return;
+
+  AuditEntry entry;
+  memset(&entry, 0xFF, sizeof(entry));
+  entry.unixTime = halUnixTime();
+  entry.uptimeMs = halMillis();
+  uint8_t digest[32];
+  halSha256((const uint8_t *)payload, strlen(payload), digest);
+  memcpy(entry.payloadHash, digest, AUDIT_HASH_LEN);
+  uint64_t latencyMs = (halMicros() - frameUs) / 1000;
+  entry.latencyMs = latencyMs > 0xFFFF ? 0xFFFF : (uint16_t)latencyMs;
+  entry.outcome = (uint8_t)outcome;
+
+  halMutexLock(auditMutex);
+  entry.seq = nextSeq++;
+  entry.check = entryCheck(&entry);
+  if (sectors > 0)
+  {
+    if (batchCount == 0)
+      batchStartMs = halMillis();
+    batch[batchCount++] = entry;
+    if (batchCount == AUDIT_BATCH_RECORDS)
+      writeBatch();
+  }
+  halMutexUnlock(auditMutex);
+
+  halLog("AUDIT: #%lu %s in %u ms\n", (unsigned long)entry.seq, outcomeNames[outcome], entry.latencyMs);
+}
+
+void auditFlush()
+{
+  if (!auditMutex)
+    return;
+  halMutexLock(auditMutex);
+  if (batchCount > 0)
+    writeBatch();
+  halMutexUnlock(auditMutex);
+}
+
+#ifdef AUDIT_UPLOAD_URL
+// ---------------------- UPLOAD ----------------------
+// A batch is "AUD1", then varints: first seq, record count, and for each
+// record its outcome (AUDIT_UNREADABLE and nothing else for a torn one),
+// the zigzag deltas of unix time and uptime from the previous record, the
+// payload hash (raw) and the latency. Records run consecutively from the
+// first seq. That is about 14 bytes a record against 32 in flash.
+#define AUDIT_MAX_ENCODED 22 // one record, worst case
+
+static HalHttpClient *uploadClient;
+static uint32_t lastUploadMs = 0;
+static uint8_t uploadBuf[16 + AUDIT_UPLOAD_RECORDS * AUDIT_MAX_ENCODED];
+
+static uint8_t *putVarint(uint8_t *p, uint32_t n)
+{
+  while (n >= 0x80)
+  {
+    *p++ = (uint8_t)(n | 0x80);
+    n >>= 7;
+  }
+  *p++ = (uint8_t)n;
+  return p;
+}
+
+static uint32_t zigzag(uint32_t from, uint32_t to)
+{
+  int32_t delta = (int32_t)(to - from);
+  return ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+}
+
+// Flash offset of a record still in the ring
+static size_t seqOffset(uint32_t seq)
+{
+  size_t sector = headSector;
+  while (seq < sectorFirstSeq[sector])
+    sector = (sector + sectors - 1) % sectors;
+  return slotOffset(sector, 1 + (seq - sectorFirstSeq[sector]));
+}
+
+static size_t encodeBatch(uint32_t from, uint32_t count)
+{
+  uint8_t *p = uploadBuf;
+  memcpy(p, "AUD1", 4);
+  p = putVarint(p + 4, from);
+  p = putVarint(p, count);
+
+  uint32_t prevUnix = 0, prevUptime = 0;
+  for (uint32_t seq = from; seq < from + count; seq++)
+  {
+    AuditEntry entry;
+    if (!halAuditRegionRead(seqOffset(seq), &entry, sizeof(entry)) || entry.seq != seq ||
+        entry.check != entryCheck(&entry))
+    {
+      *p++ = AUDIT_UNREADABLE;
+      continue;
+    }
+    *p++ = entry.outcome;
+    p = putVarint(p, zigzag(prevUnix, entry.unixTime));
+    p = putVarint(p, zigzag(prevUptime, entry.uptimeMs));
+    memcpy(p, entry.payloadHash, AUDIT_HASH_LEN);
+    p = putVarint(p + AUDIT_HASH_LEN, entry.latencyMs);
+    prevUnix = entry.unixTime;
+    prevUptime = entry.uptimeMs;
+  }
+  return (size_t)(p - uploadBuf);
+}
+
+// Sends the oldest records the server hasn't acknowledged: a full batch
+// whenever one is waiting, a partial one at most every AUDIT_UPLOAD_MS
+static void uploadPending()
+{
+  halMutexLock(auditMutex);
+  uint32_t flashed = nextSeq - 1 - (uint32_t)batchCount;
+  uint32_t oldest = oldestSeq();
+  uint32_t from = sentSeq + 1 > oldest ? sentSeq + 1 : oldest;
+  uint32_t pending = flashed >= from ? flashed - from + 1 : 0;
+  bool due = pending >= AUDIT_UPLOAD_RECORDS ||
+             (pending > 0 && halMillis() - lastUploadMs >= AUDIT_UPLOAD_MS);
+  uint32_t count = pending < AUDIT_UPLOAD_RECORDS ? pending : AUDIT_UPLOAD_RECORDS;
+  size_t len = due ? encodeBatch(from, count) : 0;
+  halMutexUnlock(auditMutex);
+  if (!due)
+    return;
+
+  lastUploadMs = halMillis();
+  char reply[64];
+  int httpCode = halHttpPost(uploadClient, AUDIT_UPLOAD_URL, "application/octet-stream", uploadBuf, len, reply,
+                             sizeof(reply), HTTP_TIMEOUT_MS);
+  if (httpCode < 200 || httpCode >= 300)
+  {
+    halLog("AUDIT: upload failed (HTTP %d)\n", httpCode);
+    return;
+  }
+
+  halMutexLock(auditMutex);
+  sentSeq = from + count - 1;
+  halMutexUnlock(auditMutex);
+  halStorageSave(AUDIT_SENT_KEY, &sentSeq, sizeof(sentSeq));
+  halLog("AUDIT: uploaded #%lu-#%lu in %u bytes\n", (unsigned long)from, (unsigned long)(from + count - 1),
+         (unsigned)len);
+}
+#endif
+
+void auditService()
+{
+  if (!auditMutex || sectors == 0)
+    return;
+
+  halMutexLock(auditMutex);
+  if (batchCount > 0 && halMillis() - batchStartMs >= AUDIT_FLUSH_MS)
+    writeBatch();
+  halMutexUnlock(auditMutex);
+
+#ifdef AUDIT_UPLOAD_URL
+  if (!uploadClient)
+    uploadClient = halHttpClientCreate();
+  if (uploadClient && halNetworkWait(0))
+    uploadPending();
+#endif
+}
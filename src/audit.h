@@ -0,0 +1,35 @@
+#pragma once
+
+// Store-and-forward audit log. Every scan outcome is appended to a ring of
+// fixed-size records in flash (halAuditRegion*), buffered in RAM and written
+// in batches. The ring advances through every sector in turn, so erases are
+// spread evenly over the region. When AUDIT_UPLOAD_URL is defined, records
+// not yet uploaded are POSTed there in delta-encoded batches while the
+// validation workers are idle.
+
+#include <stdint.h>
+
+enum AuditOutcome
+{
+  AUDIT_DENIED,         // by the server
+  AUDIT_GRANTED,        // by the server
+  AUDIT_GRANTED_CACHED, // from the offline cache
+  AUDIT_GRANTED_SIGNED, // signed payload, verified locally
+  AUDIT_UNREACHABLE,    // no answer from the server, denied
+  AUDIT_DENIED_RECENT   // refused by the server moments ago, not asked again
+};
+
+// Finds the ring's head in flash. Without a region, outcomes are only logged.
+bool auditInit();
+
+// Records an outcome for payload. frameUs is the capture time of the frame
+// the code was found in, for the scan-to-decision latency. Safe to call from
+// several tasks; only writes to flash when the RAM batch is full.
+void auditRecord(const char *payload, AuditOutcome outcome, uint64_t frameUs);
+
+// Housekeeping for an idle period: writes a batch older than AUDIT_FLUSH_MS
+// and uploads pending records. Blocks for the upload.
+void auditService();
+
+// Writes any buffered records now, e.g. before a restart or deep sleep.
+void auditFlush();
@@ -0,0 +1,105 @@
+#include "binarize.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BINARIZE_SSE2
+#endif
+
+#define TILE_SHIFT 8 // log2(16 * 16)
+
+// ---------------------- SCALAR ----------------------
+void tileMeansScalar(const uint8_t *image, uint16_t width, uint16_t height, uint8_t *means)
+{
+  uint16_t tilesX = width / BINARIZE_TILE_PX;
+  uint16_t tilesY = height / BINARIZE_TILE_PX;
+  for (uint16_t ty = 0; ty < tilesY; ty++)
+  {
+    for (uint16_t tx = 0; tx < tilesX; tx++)
+    {
+      const uint8_t *tile = image + (size_t)ty * BINARIZE_TILE_PX * width + (size_t)tx * BINARIZE_TILE_PX;
+      uint32_t sum = 0;
+      for (int y = 0; y < BINARIZE_TILE_PX; y++)
+      {
+        const uint8_t *row = tile + (size_t)y * width;
+        for (int x = 0; x < BINARIZE_TILE_PX; x++)
+          sum += row[x];
+      }
+      means[(size_t)ty * tilesX + tx] = (uint8_t)(sum >> TILE_SHIFT);
+    }
+  }
+}
+
+void binarizeRowScalar(const uint8_t *row, uint16_t width, const uint8_t *thresholds, uint8_t *out)
+{
+  uint16_t tilesX = width / BINARIZE_TILE_PX;
+  for (uint16_t tx = 0; tx < tilesX; tx++)
+  {
+    uint8_t threshold = thresholds[tx];
+    const uint8_t *src = row + (size_t)tx * BINARIZE_TILE_PX;
+    uint8_t *dst = out + (size_t)tx * BINARIZE_TILE_PX;
+    for (int x = 0; x < BINARIZE_TILE_PX; x++)
+      dst[x] = src[x] < threshold ? 1 : 0;
+  }
+}
+
+// ---------------------- SSE2 ----------------------
+#ifdef BINARIZE_SSE2
+void tileMeans(const uint8_t *image, uint16_t width, uint16_t height, uint8_t *means)
+{
+  uint16_t tilesX = width / BINARIZE_TILE_PX;
+  uint16_t tilesY = height / BINARIZE_TILE_PX;
+  const __m128i zero = _mm_setzero_si128();
+  for (uint16_t ty = 0; ty < tilesY; ty++)
+  {
+    for (uint16_t tx = 0; tx < tilesX; tx++)
+    {
+      const uint8_t *tile = image + (size_t)ty * BINARIZE_TILE_PX * width + (size_t)tx * BINARIZE_TILE_PX;
+
+      // psadbw against zero sums each 8-byte half of a row into a 64-bit lane
+      __m128i acc = zero;
+      for (int y = 0; y < BINARIZE_TILE_PX; y++)
+      {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(tile + (size_t)y * width));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(pixels, zero));
+      }
+      uint32_t sum = (uint32_t)_mm_cvtsi128_si32(acc) + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+      means[(size_t)ty * tilesX + tx] = (uint8_t)(sum >> TILE_SHIFT);
+    }
+  }
+}
+
+void binarizeRow(const uint8_t *row, uint16_t width, const uint8_t *thresholds, uint8_t *out)
+{
+  uint16_t tilesX = width / BINARIZE_TILE_PX;
+  const __m128i one = _mm_set1_epi8(1);
+  for (uint16_t tx = 0; tx < tilesX; tx++)
+  {
+    __m128i pixels = _mm_loadu_si128((const __m128i *)(row + (size_t)tx * BINARIZE_TILE_PX));
+    __m128i threshold = _mm_set1_epi8((char)thresholds[tx]);
+
+    // Unsigned pixel >= threshold exactly when max(pixel, threshold) == pixel
+    __m128i light = _mm_cmpeq_epi8(_mm_max_epu8(pixels, threshold), pixels);
+    _mm_storeu_si128((__m128i *)(out + (size_t)tx * BINARIZE_TILE_PX), _mm_andnot_si128(light, one));
+  }
+}
+
+const char *binarizeKernelName()
+{
+  return "sse2";
+}
+#else
+void tileMeans(const uint8_t *image, uint16_t width, uint16_t height, uint8_t *means)
+{
+  tileMeansScalar(image, width, height, means);
+}
+
+void binarizeRow(const uint8_t *row, uint16_t width, const uint8_t *thresholds, uint8_t *out)
+{
+  binarizeRowScalar(row, width, thresholds, out);
+}
+
+const char *binarizeKernelName()
+{
+  return "scalar";
+}
+#endif
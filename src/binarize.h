@@ -0,0 +1,30 @@
+#pragma once
+
+// Grayscale front-end kernels for the decoder: per-tile mean luma (the
+// motion gate and the local thresholds) and row binarization against those
+// thresholds (the finder-pattern pre-scan). Each kernel has a scalar
+// reference version and a vector version, chosen at compile time. The host
+// build uses SSE2 on x86. Targets without one use the scalar code. Both
+// versions give bit-identical output.
+//
+// Tiles are BINARIZE_TILE_PX square. Partial tiles at the right and bottom
+// edges are ignored.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BINARIZE_TILE_PX 16 // one tile row is one 128-bit vector
+#define BINARIZE_DARK_PCT 90 // a pixel is dark below this % of its tile's mean
+
+// means[ty * (width / 16) + tx] = mean of tile (tx, ty), rounded down
+void tileMeans(const uint8_t *image, uint16_t width, uint16_t height, uint8_t *means);
+
+// out[x] = 1 (dark) if row[x] < thresholds[x / 16], else 0, for
+// x < width rounded down to whole tiles
+void binarizeRow(const uint8_t *row, uint16_t width, const uint8_t *thresholds, uint8_t *out);
+
+// Scalar reference versions, used directly when no vector unit is available
+void tileMeansScalar(const uint8_t *image, uint16_t width, uint16_t height, uint8_t *means);
+void binarizeRowScalar(const uint8_t *row, uint16_t width, const uint8_t *thresholds, uint8_t *out);
+
+const char *binarizeKernelName(); // "sse2" or "scalar"
@@ -1,63 +1,117 @@
-#include <esp32-hal-ledc.h>
-#include <esp32-hal.h>
+#include "buzzer.h"
+#include "hal.h"
 
-#define BUZZER_PIN     21          // Set your buzzer GPIO pin here
-#define BUZZER_CHANNEL 0           // LEDC channel
-#define BUZZER_FREQ    2000        // Default freq for LEDC timer (not tone freq)
-#define BUZZER_RES     8           // PWM resolution (8 bits)
 #define TONE_DEFAULT_DELAY 80      // Recommended default tone duration in ms
+#define TONE_GAP_MS 20             // small gap to separate tones
+#define BUZZER_QUEUE_DEPTH 4       // patterns waiting to play; extra beeps are dropped
+#define BUZZER_MAX_STEPS 3
 
-// Initialize buzzer PWM channel, attach pin - call this once in setup()
+struct ToneStep {
+  uint16_t frequency;   // Hz
+  uint16_t durationMs;  // tone on
+  uint16_t gapMs;       // silence after the tone
+};
+
+struct TonePattern {
+  uint8_t count;
+  ToneStep steps[BUZZER_MAX_STEPS];
+};
+
+static const TonePattern patterns[BEEP_PATTERN_COUNT] = {
+  // BEEP_STARTUP: mid tone, then higher tone, feels fresh/modern
+  {2, {{1000, 120, TONE_GAP_MS + 50}, {2000, 200, TONE_GAP_MS}}},
+  // BEEP_SHUTDOWN
+  {2, {{800, 100, TONE_GAP_MS + 50}, {600, 100, TONE_GAP_MS}}},
+  // BEEP_SUCCESS
+  {3, {{1000, 100, TONE_GAP_MS}, {1400, 100, TONE_GAP_MS}, {1800, 120, TONE_GAP_MS}}},
+  // BEEP_FAIL
+  {2, {{800, 200, TONE_GAP_MS}, {500, 300, TONE_GAP_MS}}},
+  // BEEP_WARNING
+  {1, {{500, 100, TONE_GAP_MS}}},
+  // BEEP_PROCESS
+  {2, {{1000, 60, TONE_GAP_MS}, {1200, 60, TONE_GAP_MS}}},
+  // BEEP_DETECT
+  {1, {{750, 40, TONE_GAP_MS}}},
+};
+
+static HalQueue buzzerQueue;
+static volatile int pendingPatterns = 0; // queued + playing
+
+// Plays queued patterns one after another. The LEDC peripheral generates
+// the tone; this task only switches it on and off, so callers never block.
+static void buzzerTask(void *pvParameters) {
+  uint8_t id;
+  while (true) {
+    if (!halQueueReceive(buzzerQueue, &id, HAL_WAIT_FOREVER)) continue;
+
+    const TonePattern &pattern = patterns[id];
+    for (uint8_t i = 0; i < pattern.count; i++) {
+      const ToneStep &step = pattern.steps[i];
+      halToneWrite(step.frequency);
+      halDelayMs(step.durationMs);
+      halToneWrite(0);
+      halDelayMs(step.gapMs);
+    }
+    __atomic_sub_fetch(&pendingPatterns, 1, __ATOMIC_RELEASE);
+  }
+}
+
+// Initialize buzzer PWM channel and start the sequencer - call this once in setup()
 void buzzerInit() {
-  ledcSetup(BUZZER_CHANNEL, BUZZER_FREQ, BUZZER_RES);
-  ledcAttachPin(BUZZER_PIN, BUZZER_CHANNEL);
-  ledcWriteTone(BUZZER_CHANNEL, 0);  // start silent
+  halToneInit();
+  buzzerQueue = halQueueCreate(BUZZER_QUEUE_DEPTH, sizeof(uint8_t));
+  if (!buzzerQueue || !halTaskCreate(buzzerTask, "Buzzer_Task", 2048, NULL, 3, 1)) {
+    halLog("ERROR: buzzer init failed\n");
+  }
 }
 
-// Helper to play a single tone, frequency (Hz) and duration (ms)
-void playTone(uint32_t frequency, uint32_t duration_ms) {
-  if (frequency == 0 || duration_ms == 0) return;
-  ledcWriteTone(BUZZER_CHANNEL, frequency);
-  vTaskDelay(duration_ms / portTICK_PERIOD_MS);
-  ledcWriteTone(BUZZER_CHANNEL, 0);
-  vTaskDelay(20 / portTICK_PERIOD_MS); // small gap to separate tones
+// Queues a pattern and returns immediately; false if the queue is full
+bool buzzerPlay(BeepPattern pattern) {
+  if (!buzzerQueue || pattern >= BEEP_PATTERN_COUNT) return false;
+
+  uint8_t id = (uint8_t)pattern;
+  __atomic_add_fetch(&pendingPatterns, 1, __ATOMIC_ACQUIRE);
+  if (!halQueueSend(buzzerQueue, &id, 0)) {
+    __atomic_sub_fetch(&pendingPatterns, 1, __ATOMIC_RELEASE);
+    return false;
+  }
+  return true;
 }
 
-void beepStartup() {
-  playTone(1000, 120);   // Mid tone
-  vTaskDelay(50 / portTICK_PERIOD_MS);
-  playTone(2000, 200);   // Higher tone, feels fresh/modern
+// Waits for queued patterns to finish, e.g. before deep sleep
+bool buzzerWaitIdle(uint32_t timeoutMs) {
+  uint32_t start = halMillis();
+  while (__atomic_load_n(&pendingPatterns, __ATOMIC_ACQUIRE) > 0) {
+    if (halMillis() - start >= timeoutMs) return false;
+    halDelayMs(10);
+  }
+  return true;
 }
 
+void beepStartup() {
+  buzzerPlay(BEEP_STARTUP);
+}
 
 void beepShutdown() {
-  playTone(800, 100);
-  vTaskDelay(50 / portTICK_PERIOD_MS);
-  playTone(600, 100);
+  buzzerPlay(BEEP_SHUTDOWN);
 }
 
 void beepSuccess() {
-  playTone(1000, 100);
-  playTone(1400, 100);
-  playTone(1800, 120);
+  buzzerPlay(BEEP_SUCCESS);
 }
 
-
 void beepFail() {
-  playTone(800, 200);
-  playTone(500, 300);
+  buzzerPlay(BEEP_FAIL);
 }
 
-
 void beepProcess() {
-  playTone(1000, 60);
-  playTone(1200, 60);
+  buzzerPlay(BEEP_PROCESS);
 }
 
 void beepDetect() {
-  playTone(750, 40);
+  buzzerPlay(BEEP_DETECT);
 }
 
 void beepWarning() {
-  playTone(500, 100);
-}
\ No newline at end of file
+  buzzerPlay(BEEP_WARNING);
+}
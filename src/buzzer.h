@@ -1,4 +1,26 @@
+#pragma once
+
+// Asynchronous tone sequencer. Patterns are queued to a dedicated buzzer
+// task, so every beep call returns immediately.
+
+#include <stdint.h>
+
+enum BeepPattern
+{
+  BEEP_STARTUP,
+  BEEP_SHUTDOWN,
+  BEEP_SUCCESS,
+  BEEP_FAIL,
+  BEEP_WARNING,
+  BEEP_PROCESS,
+  BEEP_DETECT,
+  BEEP_PATTERN_COUNT
+};
+
 void buzzerInit();
+bool buzzerPlay(BeepPattern pattern);
+bool buzzerWaitIdle(uint32_t timeoutMs);
+
 void beepStartup();
 void beepShutdown();
 void beepSuccess();
@@ -0,0 +1,64 @@
+#pragma once
+
+// ---------------------- CONFIG ----------------------
+#define ENQUEUE_TIMEOUT_MS 500        // max wait to enqueue URL
+#define QR_DEBOUNCE_MS 10000          // ignore same QR for 10s
+#define INVALID_DEBOUNCE_MS 3000      // ignore repeated invalid QR for 3s
+#define RECENT_SCAN_SETS 8            // recent-scan table sets (4 ways each), payloads debounced at once
+#define RECENT_DENY_MS 30000          // a payload the server refused this recently is denied without asking (0 = off)
+#define RESULT_DISPLAY_MS 2000        // show ACCESS GRANTED/DENIED
+#define NO_QR_CLEAR_DELAY 500         // wait 500ms of no detection before clearing
+#define QR_GATE_DIFF 6                // mean tile luma change that counts as motion
+#define QR_GATE_HOLD_MS 1500          // keep decoding every frame this long after motion or a code
+#define QR_GATE_REFRESH_MS 1000       // decode a static scene at least this often
+#define QR_ROI_MARGIN_PCT 50          // crop margin around the last code, % of its size
+#define QR_FINDER_PRESCAN 1           // skip full-frame decodes with no finder-pattern profile
+#define CAMERA_AUTO_TUNE 1            // adjust resolution, exposure target and gain ceiling from decode results
+#define TUNE_WINDOW_MS 3000           // decode results are judged over windows this long
+#define TUNE_MIN_FRAMES 8             // frames past the motion gate a window needs to be judged (fewer: nobody in front)
+#define TUNE_LUMA_LOW 70              // code region darker than this: raise the exposure target
+#define TUNE_LUMA_HIGH 190            // brighter than this: lower it
+#define TUNE_MIN_CONTRAST 64          // flatter code region: move its luma towards mid-grey
+#define TUNE_BACKLIGHT_DIFF 32        // centre this much darker than the edges and no code located: backlit
+#define TUNE_SMALL_CODE_PCT 20        // failing codes narrower than this % of the frame: switch to VGA
+#define TUNE_LARGE_CODE_PCT 40        // codes wider than this at VGA: back to QVGA for the frame rate
+#define TUNE_FRAME_BUDGET_MS 60       // mean decode time above this at VGA: back to QVGA
+#define TUNE_REVERT_PCT 10            // a change that costs this many points of decode rate is undone
+#define TUNE_HOLD_MS 60000            // after undoing a change, settings stay put this long
+#define STREAM_JPEG_QUALITY 80        // debug stream JPEG quality (encoded once per frame)
+#define STREAM_MAX_VIEWERS 3          // concurrent /stream clients, more get 503
+#define STREAM_MAX_FPS 15             // per-client frame rate cap (?fps= can only lower it)
+#define STREAM_FLUSH_POLL_MS 20       // how often backed-up clients are retried
+#define BUZZER_PIN 21                 // GPIO pin for buzzer
+#define POWER_IDLE_AFTER_MS 30000     // no code or motion this long: slower frames, CPU and radio power save
+#define POWER_IDLE_FRAME_MS 200       // capture interval while idle (5 fps)
+#define POWER_STANDBY_AFTER_MS 120000 // no code or motion this long: sensor clock slowed as well
+#define POWER_STANDBY_FRAME_MS 1000   // capture interval in standby
+#define POWER_SETTLE_MS 3000          // motion right after a tier change is the sensor adjusting, not a person
+#define POWER_MOTION_POLL_MS 250      // below the active tier, motion is checked this often
+#define SHUTDOWN_AFTER_MS 300000      // shutdown after inactivity
+#define MOTION_WAKE_PIN -1            // RTC GPIO of a PIR sensor that wakes from deep sleep (-1 = button only)
+#define RESTART_BUTTON_PIN 14         // Using GPIO 14 as our button input
+#define RESTART_DEBOUNCE_MS 500       // restart this long after the press
+#define PROMPT_TEXT " [Scan QR code]" // Prompt text
+#define LOCK_PIN 19                   // GPIO pin to control the lock (HIGH to unlock, LOW to lock)
+#define LOCK_UNLOCK_DURATION_MS 5000  // Duration to keep the lock unlocked
+#define GRANT_MAX_UNLOCK_MS 30000     // cap on a server-set unlock duration
+#define HTTP_TIMEOUT_MS 10000         // max wait for the validation server
+#define HTTP_AUDIT_TIMEOUT_MS 2000    // max wait for the audit request after a local grant
+#define HTTP_KEEPALIVE_CHECK_MS 5000  // idle interval to re-open a dropped validation connection
+#define NETWORK_WAIT_MS 15000         // scans wait this long for WiFi after boot, then count as unreachable
+#define WIFI_FAST_CONNECT_MS 3000     // after deep sleep, try the cached access point this long before scanning
+#define WIFI_REUSE_IP_S 1800          // reuse the cached address after a sleep shorter than this (0 = always DHCP)
+#define URL_QUEUE_DEPTH 4             // accepted scans waiting for a validation worker
+#define VALIDATION_WORKERS 2          // validation requests in flight at once
+#define ACCESS_CACHE_TTL_S 3600       // how long a server grant can be reused offline, unless it sets ttl_s
+#define ACCESS_CACHE_MAX_TTL_S 604800 // cap on a server-set ttl_s (7 days)
+#define ACCESS_CACHE_SETS 64          // cache sets (4 ways each)
+#define ACCESS_CACHE_PERSIST_MS 60000 // min interval between cache writes to flash
+#define NTP_SERVER "pool.ntp.org"     // wall clock for cache TTLs and signed-payload expiry
+#define AUDIT_BATCH_RECORDS 16        // audit records buffered in RAM per flash write
+#define AUDIT_FLUSH_MS 30000          // max age of a buffered audit record once the workers are idle
+#define AUDIT_UPLOAD_RECORDS 128      // audit records per upload (AUDIT_UPLOAD_URL)
+#define AUDIT_UPLOAD_MS 60000         // min interval between uploads of a partial batch
+#define PROFILE_INTERVAL_MS 600000    // task/stack/heap profile to serial and /profile
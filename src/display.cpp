@@ -0,0 +1,127 @@
+#include <string.h>
+#include "display.h"
+#include "hal.h"
+#include "lcd.h"
+#include "metrics.h"
+
+// A changed run is carried over gaps of up to this many unchanged
+// characters: moving the cursor is an HD44780 command, which costs the
+// same on the bus as rewriting one character
+#define DISPLAY_MERGE_GAP 1
+
+// What the tasks asked for, under displayMutex
+static char wanted[DISPLAY_ROWS][DISPLAY_COLS];
+static bool wantOff = false;
+static HalMutex displayMutex;
+static HalEvent displayChanged;
+
+// What the panel shows; only the LCD task touches these
+static char shown[DISPLAY_ROWS][DISPLAY_COLS];
+static bool shownValid = false; // lcdInit() left text of its own
+static bool panelOff = false;
+
+bool displayInit()
+{
+  memset(wanted, ' ', sizeof(wanted));
+  displayMutex = halMutexCreate();
+  displayChanged = halEventCreate();
+  return displayMutex && displayChanged;
+}
+
+// Copies row into the wanted line. Returns whether that changed it.
+static bool setLine(uint8_t line, const char *row)
+{
+  if (memcmp(wanted[line], row, DISPLAY_COLS) == 0)
+    return false;
+  memcpy(wanted[line], row, DISPLAY_COLS);
+  return true;
+}
+
+void displayShow(uint8_t line, const char *text, bool clearOther)
+{
+  if (line >= DISPLAY_ROWS)
+    return;
+
+  char row[DISPLAY_COLS];
+  size_t len = strnlen(text, DISPLAY_COLS);
+  memcpy(row, text, len);
+  memset(row + len, ' ', DISPLAY_COLS - len);
+  char blankRow[DISPLAY_COLS];
+  memset(blankRow, ' ', DISPLAY_COLS);
+
+  halMutexLock(displayMutex);
+  bool changed = setLine(line, row);
+  for (uint8_t other = 0; clearOther && other < DISPLAY_ROWS; other++)
+  {
+    if (other != line)
+      changed |= setLine(other, blankRow);
+  }
+  halMutexUnlock(displayMutex);
+
+  if (changed)
+    halEventSignal(displayChanged);
+}
+
+void displayOff()
+{
+  halMutexLock(displayMutex);
+  wantOff = true;
+  halMutexUnlock(displayMutex);
+  halEventSignal(displayChanged);
+}
+
+bool displayRender(uint32_t timeoutMs)
+{
+  if (!halEventWait(displayChanged, timeoutMs))
+    return false;
+
+  char frame[DISPLAY_ROWS][DISPLAY_COLS];
+  halMutexLock(displayMutex);
+  memcpy(frame, wanted, sizeof(frame));
+  bool off = wantOff;
+  halMutexUnlock(displayMutex);
+
+  if (panelOff)
+    return true;
+  if (off)
+  {
+    lcdOff();
+    panelOff = true;
+    halLog("LCD: Turned off.\n");
+    return true;
+  }
+
+  // Send each run of changed characters with one cursor move
+  uint32_t sent = 0;
+  for (uint8_t row = 0; row < DISPLAY_ROWS; row++)
+  {
+    int col = 0;
+    while (col < DISPLAY_COLS)
+    {
+      if (shownValid && frame[row][col] == shown[row][col])
+      {
+        col++;
+        continue;
+      }
+      int end = col + 1;
+      for (int next = end; next < DISPLAY_COLS && next - end <= DISPLAY_MERGE_GAP; next++)
+      {
+        if (!shownValid || frame[row][next] != shown[row][next])
+          end = next + 1;
+      }
+
+      lcdWrite(col, row, &frame[row][col], end - col);
+      memcpy(&shown[row][col], &frame[row][col], end - col);
+      sent += end - col;
+      col = end;
+    }
+  }
+  shownValid = true;
+
+  if (sent > 0)
+  {
+    metricsCount(MET_LCD_UPDATES);
+    metricsAdd(MET_LCD_CHARS_SENT, sent);
+  }
+  return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// Shadow framebuffer for the 16x2 LCD. Tasks set what each line should say
+// and return at once. Nothing is queued, so a burst of updates collapses
+// into the latest text. The LCD task compares that with what the panel
+// shows and sends only the characters that differ. When the text doesn't
+// change, the task sleeps and the I2C bus stays idle.
+
+#include <stdint.h>
+
+#define DISPLAY_COLS 16
+#define DISPLAY_ROWS 2
+
+// Call once after lcdInit(). The first render rewrites the whole panel.
+bool displayInit();
+
+// Sets line to text, cut or padded with blanks to DISPLAY_COLS. clearOther
+// blanks the other line in the same update.
+void displayShow(uint8_t line, const char *text, bool clearOther = false);
+
+// Turns the panel and backlight off; later updates are ignored.
+void displayOff();
+
+// Waits up to timeoutMs for a change and sends it to the LCD. Returns false
+// on timeout. Called by the LCD task only.
+bool displayRender(uint32_t timeoutMs);
@@ -0,0 +1,270 @@
+#include <atomic>
+#include <stdlib.h>
+#include "config.h"
+#include "frame_ring.h"
+#include "latency.h"
+#include "metrics.h"
+
+// A slot's refs counts consumer references plus one while it is the newest
+// frame. The last release moves it to SLOT_RETIRING while the framebuffer is
+// handed back, then to 0. Consumers only ever increment a positive count, so
+// a slot at 0 belongs to the capture task alone and is refilled without a lock.
+#define SLOT_RETIRING -1
+
+enum JpegState
+{
+  JPEG_NONE,
+  JPEG_ENCODING,
+  JPEG_READY,
+  JPEG_FAILED
+};
+
+struct FrameRef
+{
+  HalFrame frame;
+  uint32_t seq;
+  std::atomic<int> refs;
+  std::atomic<int> jpegState;
+  uint8_t *jpeg;
+  size_t jpegLen;
+};
+
+static FrameRef slots[FRAME_RING_SLOTS];
+static std::atomic<int> newest(-1);
+static std::atomic<uint32_t> newestSeq(0);
+
+static HalEvent subscriberEvents[FRAME_RING_SUBSCRIBERS];
+static std::atomic<bool> subscriberUsed[FRAME_RING_SUBSCRIBERS];
+static HalMutex subscriberMutex;
+
+static std::atomic<uint32_t> captureIntervalMs(0);
+static HalEvent intervalChanged; // also wakes the task for a reconfigure
+static std::atomic<FrameRingFn> reconfigure(NULL);
+
+// ---------------------- CONSUMERS ----------------------
+int frameRingSubscribe()
+{
+  halMutexLock(subscriberMutex);
+  int id = -1;
+  for (int i = 0; i < FRAME_RING_SUBSCRIBERS && id < 0; i++)
+  {
+    if (!subscriberUsed[i])
+    {
+      subscriberUsed[i] = true;
+      id = i;
+    }
+  }
+  halMutexUnlock(subscriberMutex);
+  return id;
+}
+
+void frameRingUnsubscribe(int subscriber)
+{
+  if (subscriber < 0 || subscriber >= FRAME_RING_SUBSCRIBERS)
+    return;
+  halMutexLock(subscriberMutex);
+  subscriberUsed[subscriber] = false;
+  halEventWait(subscriberEvents[subscriber], 0); // don't hand a stale wakeup to the next owner
+  halMutexUnlock(subscriberMutex);
+}
+
+// References the newest slot, or returns NULL if none is published
+static FrameRef *acquireNewest()
+{
+  while (true)
+  {
+    int index = newest.load(std::memory_order_acquire);
+    if (index < 0)
+      return NULL;
+
+    FrameRef *ref = &slots[index];
+    int refs = ref->refs.load(std::memory_order_acquire);
+    if (refs <= 0)
+      continue; // retired between the two loads; newest has moved on
+    if (ref->refs.compare_exchange_weak(refs, refs + 1, std::memory_order_acq_rel))
+      return ref;
+  }
+}
+
+FrameRef *frameRingAcquire(int subscriber, uint32_t afterSeq, uint32_t timeoutMs)
+{
+  uint32_t startMs = halMillis();
+  while (true)
+  {
+    if (newestSeq.load(std::memory_order_acquire) > afterSeq)
+    {
+      FrameRef *ref = acquireNewest();
+      if (ref && ref->seq > afterSeq)
+        return ref;
+      if (ref)
+        frameRingRelease(ref);
+    }
+
+    uint32_t waitedMs = halMillis() - startMs;
+    if (timeoutMs != HAL_WAIT_FOREVER && waitedMs >= timeoutMs)
+      return NULL;
+    halEventWait(subscriberEvents[subscriber], timeoutMs == HAL_WAIT_FOREVER ? HAL_WAIT_FOREVER : timeoutMs - waitedMs);
+  }
+}
+
+const HalFrame *frameRingFrame(const FrameRef *ref)
+{
+  return &ref->frame;
+}
+
+uint32_t frameRingSeq(const FrameRef *ref)
+{
+  return ref->seq;
+}
+
+bool frameRingJpeg(FrameRef *ref, const uint8_t **buf, size_t *len)
+{
+  int state = JPEG_NONE;
+  if (ref->jpegState.compare_exchange_strong(state, JPEG_ENCODING, std::memory_order_acq_rel))
+  {
+    bool ok = halCameraEncodeJpeg(&ref->frame, STREAM_JPEG_QUALITY, &ref->jpeg, &ref->jpegLen);
+    state = ok ? JPEG_READY : JPEG_FAILED;
+    ref->jpegState.store(state, std::memory_order_release);
+  }
+
+  // Another consumer is encoding this frame; wait for it rather than encode twice
+  while (state == JPEG_ENCODING)
+  {
+    halDelayMs(1);
+    state = ref->jpegState.load(std::memory_order_acquire);
+  }
+
+  if (state != JPEG_READY)
+    return false;
+  *buf = ref->jpeg;
+  *len = ref->jpegLen;
+  return true;
+}
+
+void frameRingRelease(FrameRef *ref)
+{
+  int refs = ref->refs.load(std::memory_order_acquire);
+  while (true)
+  {
+    int next = refs == 1 ? SLOT_RETIRING : refs - 1;
+    if (ref->refs.compare_exchange_weak(refs, next, std::memory_order_acq_rel))
+      break;
+  }
+  if (refs != 1)
+    return;
+
+  // Last reference: hand the framebuffer back to the driver, then free the slot
+  halCameraFrameReturn(&ref->frame);
+  free(ref->jpeg);
+  ref->jpeg = NULL;
+  ref->jpegLen = 0;
+  ref->jpegState.store(JPEG_NONE, std::memory_order_relaxed);
+  ref->refs.store(0, std::memory_order_release);
+}
+
+// ---------------------- CAPTURE TASK ----------------------
+static FrameRef *freeSlot()
+{
+  for (int i = 0; i < FRAME_RING_SLOTS; i++)
+  {
+    if (slots[i].refs.load(std::memory_order_acquire) == 0)
+      return &slots[i];
+  }
+  return NULL;
+}
+
+// Retires the newest frame and waits for the consumers to release the rest.
+// Consumers only reference slots with a positive count, so once every slot
+// reads 0 no framebuffer is out.
+static void drainAndRun(FrameRingFn fn)
+{
+  int previous = newest.exchange(-1, std::memory_order_acq_rel);
+  if (previous >= 0)
+    frameRingRelease(&slots[previous]);
+  for (int i = 0; i < FRAME_RING_SLOTS; i++)
+  {
+    while (slots[i].refs.load(std::memory_order_acquire) != 0)
+      halDelayMs(5);
+  }
+  fn();
+}
+
+static void captureTask(void *arg)
+{
+  uint32_t seq = 0;
+  HalFrame frame;
+  while (true)
+  {
+    FrameRingFn fn = reconfigure.exchange(NULL, std::memory_order_acq_rel);
+    if (fn)
+      drainAndRun(fn);
+
+    uint64_t captureStartUs = halMicros();
+    if (!halCameraFrameGet(&frame))
+    {
+      halDelayMs(10);
+      continue;
+    }
+    latencyRecord(LAT_CAPTURE, captureStartUs, halMicros());
+
+    // Every slot still referenced: drop this frame rather than wait on a
+    // slow consumer
+    FrameRef *slot = freeSlot();
+    if (!slot)
+    {
+      halCameraFrameReturn(&frame);
+      continue;
+    }
+
+    slot->frame = frame;
+    slot->seq = ++seq;
+    slot->refs.store(1, std::memory_order_release); // the ring's own "newest" reference
+
+    int previous = newest.exchange((int)(slot - slots), std::memory_order_acq_rel);
+    newestSeq.store(seq, std::memory_order_release);
+    metricsCount(MET_FRAMES_CAPTURED);
+    if (previous >= 0)
+      frameRingRelease(&slots[previous]);
+
+    for (int i = 0; i < FRAME_RING_SUBSCRIBERS; i++)
+    {
+      if (subscriberUsed[i].load(std::memory_order_relaxed))
+        halEventSignal(subscriberEvents[i]);
+    }
+
+    // Power-saving frame rate: wait out the rest of the interval
+    uint32_t intervalMs = captureIntervalMs.load(std::memory_order_relaxed);
+    uint32_t elapsedMs = (uint32_t)((halMicros() - captureStartUs) / 1000);
+    if (intervalMs > elapsedMs)
+      halEventWait(intervalChanged, intervalMs - elapsedMs);
+  }
+}
+
+void frameRingSetInterval(uint32_t intervalMs)
+{
+  captureIntervalMs.store(intervalMs, std::memory_order_relaxed);
+  if (intervalChanged)
+    halEventSignal(intervalChanged);
+}
+
+void frameRingReconfigure(FrameRingFn fn)
+{
+  reconfigure.store(fn, std::memory_order_release);
+  if (intervalChanged)
+    halEventSignal(intervalChanged);
+}
+
+bool frameRingStart(int core)
+{
+  subscriberMutex = halMutexCreate();
+  intervalChanged = halEventCreate();
+  if (!subscriberMutex || !intervalChanged)
+    return false;
+  for (int i = 0; i < FRAME_RING_SUBSCRIBERS; i++)
+  {
+    subscriberEvents[i] = halEventCreate();
+    if (!subscriberEvents[i])
+      return false;
+  }
+  return halTaskCreate(captureTask, "Camera_Capture_Task", 4 * 1024, NULL, 5, core);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+// Single-producer ring of camera frames shared by every consumer (the QR
+// decode task and the MJPEG stream task). One capture task owns the camera
+// and publishes each framebuffer into a slot. Consumers take a reference to
+// the newest frame without copying it. The framebuffer goes back to the
+// driver when the last reference is released and a newer frame has been
+// published. JPEG is encoded at most once per frame, by the first consumer
+// that asks for it.
+//
+// Publishing and acquiring are lock-free. Subscribing takes a mutex, so do
+// it once per consumer, not per frame.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hal.h"
+
+#define FRAME_RING_SLOTS 3       // frames held at once (newest + ones still being read)
+#define FRAME_RING_SUBSCRIBERS 4 // decoder + stream task, with room to spare
+
+struct FrameRef; // a referenced ring slot
+
+typedef void (*FrameRingFn)();
+
+// Starts the capture task on the given core. Call once after halCameraInit().
+bool frameRingStart(int core);
+
+// Spaces captures at least intervalMs apart (0 = as fast as the camera
+// delivers). Takes effect at once, even mid-wait.
+void frameRingSetInterval(uint32_t intervalMs);
+
+// Runs fn on the capture task once every framebuffer is back with the
+// driver, for changes that need the camera re-initialized. The newest frame
+// is retired and no frame is captured until fn returns. Returns at once.
+void frameRingReconfigure(FrameRingFn fn);
+
+// Registers a consumer to be woken on each new frame. Returns its id, or -1
+// when all FRAME_RING_SUBSCRIBERS ids are taken.
+int frameRingSubscribe();
+void frameRingUnsubscribe(int subscriber);
+
+// Waits up to timeoutMs for a frame newer than afterSeq (0 = any) and
+// references it. Returns NULL on timeout. Frames published while the
+// consumer was busy are skipped: it always gets the newest frame.
+FrameRef *frameRingAcquire(int subscriber, uint32_t afterSeq, uint32_t timeoutMs);
+
+const HalFrame *frameRingFrame(const FrameRef *ref);
+uint32_t frameRingSeq(const FrameRef *ref);
+
+// The frame as JPEG, valid until the reference is released. Encoded on the
+// first call for this frame; later callers wait for that encode and share it.
+bool frameRingJpeg(FrameRef *ref, const uint8_t **buf, size_t *len);
+
+void frameRingRelease(FrameRef *ref);
@@ -0,0 +1,128 @@
+#include <ArduinoJson.h>
+#include <string.h>
+#include "config.h"
+#include "grant.h"
+#include "hal.h"
+
+// Bump allocator over a fixed buffer. Each block carries its size so a
+// block can be moved when it grows. ArduinoJson only ever grows the last
+// block (a string being built), which is extended in place. Blocks start on
+// max_align_t boundaries, whatever the alignment of the caller's buffer.
+class ArenaAllocator : public ArduinoJson::Allocator
+{
+public:
+  ArenaAllocator(uint8_t *buf, size_t size) : buf(buf), size(size), used(0), last(NULL)
+  {
+    size_t skip = (ALIGN - (uintptr_t)buf % ALIGN) % ALIGN;
+    used = skip < size ? skip : size;
+  }
+
+  void *allocate(size_t n) override
+  {
+    size_t need = blockSize(n);
+    if (need > size - used)
+      return NULL;
+    uint8_t *block = buf + used;
+    *(size_t *)block = n;
+    used += need;
+    last = block + HEADER;
+    return last;
+  }
+
+  void deallocate(void *p) override
+  {
+    if (p && p == last)
+    {
+      used = (uint8_t *)p - HEADER - buf;
+      last = NULL;
+    }
+  }
+
+  void *reallocate(void *p, size_t n) override
+  {
+    if (!p)
+      return allocate(n);
+    size_t *blockLen = (size_t *)((uint8_t *)p - HEADER);
+    if (p == last)
+    {
+      size_t start = (uint8_t *)blockLen - buf;
+      if (blockSize(n) > size - start)
+        return NULL;
+      *blockLen = n;
+      used = start + blockSize(n);
+      return p;
+    }
+    if (n <= *blockLen)
+      return p; // shrinking in the middle: keep the space
+    void *moved = allocate(n);
+    if (moved)
+      memcpy(moved, p, *blockLen);
+    return moved;
+  }
+
+private:
+  static const size_t ALIGN = alignof(max_align_t);
+  static const size_t HEADER = ALIGN; // the block's size, padded so its data stays aligned
+  static_assert(sizeof(size_t) <= HEADER, "block size must fit its header");
+
+  static size_t blockSize(size_t n)
+  {
+    return HEADER + ((n + ALIGN - 1) & ~(ALIGN - 1));
+  }
+
+  uint8_t *buf;
+  size_t size;
+  size_t used;
+  void *last;
+};
+
+// Reads a non-negative integer field, capped at max
+static uint32_t clampedField(const JsonDocument &doc, const char *key, uint32_t fallback, uint32_t max)
+{
+  JsonVariantConst value = doc[key];
+  if (!value.is<long>())
+    return fallback;
+  long n = value.as<long>();
+  if (n < 0)
+    return fallback;
+  return (unsigned long)n > max ? max : (uint32_t)n;
+}
+
+bool grantParse(const char *body, size_t len, uint8_t *arena, size_t arenaLen, GrantResponse *out)
+{
+  out->granted = false;
+  out->unlockMs = 0;
+  out->cacheTtlS = ACCESS_CACHE_TTL_S;
+  out->text[0] = '\0';
+
+  size_t start = 0;
+  while (start < len && (body[start] == ' ' || body[start] == '\t' || body[start] == '\r' || body[start] == '\n'))
+    start++;
+  if (start == len)
+    return true; // empty: deny
+  if (body[start] != '{')
+  {
+    out->granted = true; // plain-text reply from a server that predates the JSON body
+    return true;
+  }
+
+  ArenaAllocator allocator(arena, arenaLen);
+  JsonDocument doc(&allocator);
+  DeserializationError err = deserializeJson(doc, body + start, len - start);
+  if (err || !doc.is<JsonObject>())
+  {
+    halLog("GRANT: unreadable response (%s)\n", err ? err.c_str() : "not an object");
+    return false;
+  }
+  out->granted = doc["grant"] | false;
+  out->unlockMs = clampedField(doc, "unlock_ms", 0, GRANT_MAX_UNLOCK_MS);
+  out->cacheTtlS = clampedField(doc, "ttl_s", ACCESS_CACHE_TTL_S, ACCESS_CACHE_MAX_TTL_S);
+
+  // The LCD has no glyphs for control characters; blank them
+  const char *text = doc["text"] | "";
+  size_t n = 0;
+  for (; text[n] != '\0' && n < GRANT_TEXT_LEN - 1; n++)
+    out->text[n] = (unsigned char)text[n] < 0x20 ? ' ' : text[n];
+  out->text[n] = '\0';
+  return true;
+}
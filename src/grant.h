@@ -0,0 +1,29 @@
+#pragma once
+
+// Parses the validation server's reply to a scan without touching the heap.
+// A JSON object body is read with ArduinoJson into a caller-owned arena:
+//
+//   {"grant": true, "unlock_ms": 3000, "text": "Welcome Sam", "ttl_s": 86400}
+//
+// Only "grant" is required. unlock_ms and ttl_s are capped by
+// GRANT_MAX_UNLOCK_MS and ACCESS_CACHE_MAX_TTL_S, and ttl_s 0 keeps the
+// grant out of the offline cache. For older servers, any other non-empty
+// body counts as a grant with the defaults. An empty body is a deny.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GRANT_BODY_BYTES 512   // response bytes kept; the rest is discarded unread
+#define GRANT_ARENA_BYTES 3072 // ArduinoJson's pools and strings for one reply
+#define GRANT_TEXT_LEN 17      // one 16-column LCD line plus NUL
+
+struct GrantResponse
+{
+  bool granted;
+  uint32_t unlockMs;         // how long to hold LOCK_PIN open, 0 = LOCK_UNLOCK_DURATION_MS
+  uint32_t cacheTtlS;        // how long the grant may be reused offline, 0 = not cached
+  char text[GRANT_TEXT_LEN]; // result line for the LCD, empty = ACCESS GRANTED/DENIED
+};
+
+// Returns false, and denies, if a JSON body doesn't fit the arena or is malformed
+bool grantParse(const char *body, size_t len, uint8_t *arena, size_t arenaLen, GrantResponse *out);
@@ -0,0 +1,194 @@
+#pragma once
+
+// Thin hardware abstraction layer. Everything the scan pipeline touches
+// (time, RTOS queues and tasks, camera, HTTP, lock GPIO, power) goes through
+// these functions so the same application code builds for the ESP32-S3
+// (hal_esp32.cpp) and for the host (host/hal_native.cpp).
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HAL_WAIT_FOREVER 0xFFFFFFFFUL // block until the operation completes
+#define QR_PAYLOAD_LEN 256            // max payload kept from a decoded QR
+
+// Marks every function an interrupt handler runs. On the ESP32 they must be
+// in IRAM: an interrupt can fire while the flash cache is off for an NVS or
+// audit write.
+#ifdef ARDUINO
+#include <esp_attr.h>
+#define HAL_ISR_ATTR IRAM_ATTR
+#else
+#define HAL_ISR_ATTR
+#endif
+
+// ---------------------- TIME ----------------------
+uint32_t halMillis();
+uint64_t halMicros();
+void halDelayMs(uint32_t ms);
+uint32_t halUnixTime(); // wall-clock seconds, 0 until the clock has been set
+
+// ---------------------- LOGGING ----------------------
+void halLog(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// ---------------------- QUEUES / TASKS ----------------------
+typedef void *HalQueue;
+typedef void *HalEvent; // binary event: signals latch until one waiter takes them
+typedef void *HalMutex;
+typedef void (*HalTaskFn)(void *arg);
+
+HalQueue halQueueCreate(size_t depth, size_t itemSize);
+bool halQueueSend(HalQueue queue, const void *item, uint32_t timeoutMs);
+bool halQueueReceive(HalQueue queue, void *item, uint32_t timeoutMs);
+HalEvent halEventCreate();
+void halEventSignal(HalEvent event);
+void halEventSignalFromIsr(HalEvent event); // the only HAL call an interrupt handler may make
+bool halEventWait(HalEvent event, uint32_t timeoutMs);
+HalMutex halMutexCreate();
+void halMutexLock(HalMutex mutex);
+void halMutexUnlock(HalMutex mutex);
+// Returning from fn ends the task.
+bool halTaskCreate(HalTaskFn fn, const char *name, uint32_t stackBytes, void *arg, int priority, int core);
+
+// ---------------------- CAMERA ----------------------
+struct QrScan
+{
+  bool valid;
+  char payload[QR_PAYLOAD_LEN];
+  uint64_t frameUs; // capture time of the frame the code was found in
+};
+
+struct HalFrame
+{
+  const uint8_t *buf; // grayscale pixels, row-major
+  size_t len;
+  uint16_t width;
+  uint16_t height;
+  uint64_t timestampUs; // capture time
+  void *priv;           // backend handle, returned with the frame
+};
+
+bool halCameraInit();
+bool halCameraReceiveQr(QrScan *out, uint32_t timeoutMs);
+
+// halMillis() time of the last frame the decoder's motion gate saw change.
+uint32_t halCameraMotionMs();
+
+// Slows the sensor's own clock while nothing happens. The motion gate keeps
+// running on the few frames it still delivers.
+void halCameraStandby(bool standby);
+
+// Sensor settings the tuner adjusts at runtime (tuner.h)
+struct CameraTuning
+{
+  bool highRes;        // VGA instead of QVGA: more pixels per module, about half the frame rate
+  int8_t aeLevel;      // auto-exposure target, -2..2
+  uint8_t gainCeiling; // auto-gain limit, 0..6 = 2x..128x
+};
+
+void halCameraTune(const CameraTuning *tuning);
+
+// The decoder's counters (qr_decoder.h).
+struct QrDecodeStats;
+void halCameraDecodeStats(QrDecodeStats *out);
+
+// Raw framebuffer access for the frame ring's capture task (frame_ring.h);
+// everything else reads frames through the ring.
+bool halCameraFrameGet(HalFrame *frame);
+void halCameraFrameReturn(HalFrame *frame);
+
+// Encodes a grayscale frame as JPEG into a malloc'd buffer the caller frees.
+// Only buf, len, width and height are used, so the frame need not come from
+// the camera.
+bool halCameraEncodeJpeg(const HalFrame *frame, int quality, uint8_t **jpeg, size_t *len);
+
+// ---------------------- NETWORK ----------------------
+// Starts joining WiFi in the background and returns at once. After a wake
+// from deep sleep the last access point, channel and (if the sleep was
+// short) address are reused, skipping the scan and DHCP.
+void halNetworkBegin();
+
+// True once connected, waiting up to timeoutMs for the first connection.
+bool halNetworkWait(uint32_t timeoutMs);
+
+// ---------------------- HTTP ----------------------
+// Each client holds one persistent keep-alive connection to the last origin
+// it used and reuses it while requests go to the same scheme/host/port.
+// A client must only be used from one task at a time.
+typedef struct HalHttpClient HalHttpClient;
+
+HalHttpClient *halHttpClientCreate();
+
+// Performs a GET and returns the HTTP status code (0 on transport failure).
+// Up to bodyLen - 1 bytes of the response body are copied into body.
+int halHttpGet(HalHttpClient *client, const char *url, char *body, size_t bodyLen, uint32_t timeoutMs);
+
+// Same for a POST of len bytes of data with the given Content-Type.
+int halHttpPost(HalHttpClient *client, const char *url, const char *contentType, const uint8_t *data, size_t len,
+                char *body, size_t bodyLen, uint32_t timeoutMs);
+
+// Opens (or re-opens after a drop) the connection to url's origin ahead of
+// the next request, so the handshake stays off the scan path.
+bool halHttpWarmup(HalHttpClient *client, const char *url);
+
+// ---------------------- CRYPTO ----------------------
+void halSha256(const uint8_t *data, size_t len, uint8_t out[32]);
+void halHmacSha256(const uint8_t *key, size_t keyLen, const uint8_t *data, size_t len, uint8_t out[32]);
+
+// ---------------------- MEMORY / STORAGE ----------------------
+void *halAllocLarge(size_t size); // zeroed, from PSRAM when present
+bool halStorageLoad(const char *key, void *buf, size_t len); // false unless exactly len bytes were stored
+bool halStorageSave(const char *key, const void *buf, size_t len);
+
+// Raw flash region for the audit log (a data partition on device, a file on
+// the host). Like NOR flash, writes can only clear bits: a sector reads as
+// 0xFF after an erase and each byte is written at most once until the next.
+#define HAL_AUDIT_SECTOR_BYTES 4096
+
+size_t halAuditRegionSize(); // bytes, a multiple of HAL_AUDIT_SECTOR_BYTES; 0 when there is none
+bool halAuditRegionRead(size_t offset, void *buf, size_t len);
+bool halAuditRegionWrite(size_t offset, const void *buf, size_t len);
+bool halAuditRegionErase(size_t sector);
+
+// ---------------------- DIAGNOSTICS ----------------------
+#define HAL_MAX_TASKS 32 // tasks reported by halTaskStats
+
+struct HalTaskStat
+{
+  char name[16];
+  uint32_t id;           // stable for the task's lifetime
+  int core;              // -1 = not pinned
+  int priority;
+  uint32_t runtime;      // CPU time in run-time clock ticks; wraps, compare samples
+  uint32_t stackBytes;   // 0 unless the task was created with halTaskCreate
+  uint32_t stackMinFree; // bytes, lowest free stack seen (high-water mark)
+};
+
+struct HalHeapStat
+{
+  const char *name;
+  size_t totalBytes;
+  size_t freeBytes;
+  size_t largestFreeBlock; // 0 when the allocator can't tell
+  size_t minFreeBytes;     // lowest free seen since boot, 0 when unknown
+};
+
+// Snapshot of every task. *totalRuntime is the run-time clock at the
+// snapshot, in the same ticks, so one core's share is a task's runtime
+// delta over the total delta. Call from one task at a time.
+size_t halTaskStats(HalTaskStat *out, size_t max, uint32_t *totalRuntime);
+size_t halHeapStats(HalHeapStat *out, size_t max); // one entry per heap (internal RAM, PSRAM)
+
+// ---------------------- GPIO / POWER ----------------------
+void halToneInit();
+void halToneWrite(uint32_t frequency);
+void halLockInit();
+void halLockWrite(bool open);
+typedef void (*HalIsrFn)(); // defined HAL_ISR_ATTR
+void halButtonInit();
+void halButtonOnPress(HalIsrFn onPress); // called from the button's interrupt
+void halRestart();
+void halDeepSleep(); // wakes on the button, or on MOTION_WAKE_PIN when one is fitted
+
+// Lowers the CPU clock and lets the radio sleep between beacons, so the CPU
+// idles cheaply between the slower frames. Off restores full speed.
+void halPowerSave(bool enable);
@@ -0,0 +1,899 @@
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <esp_camera.h>
+#include <esp_heap_caps.h>
+#include <esp_idf_version.h>
+#include <esp_partition.h>
+#include <img_converters.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <mbedtls/md.h>
+#include <time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <stdarg.h>
+#include <camera_pins.h>
+#include "config.h"
+#include "frame_ring.h"
+#include "hal.h"
+#include "latency.h"
+#include "qr_decoder.h"
+
+#define BUZZER_CHANNEL 0 // LEDC channel
+#define BUZZER_FREQ 2000 // Default freq for LEDC timer (not tone freq)
+#define BUZZER_RES 8     // PWM resolution (8 bits)
+#define STORAGE_NAMESPACE "qrscan"
+#define CLOCK_VALID_AFTER 1600000000UL // anything earlier means SNTP has not run
+#define QR_QUEUE_DEPTH 4
+#define CAMERA_XCLK_HZ 10000000 // what ESP32QRCodeReader used
+#define OV2640_REG_CLKRC 0x111  // sensor-bank clock divider (bit 8 selects the bank)
+#define OV2640_STANDBY_DIV 0x1F // CLKRC divider in standby, 32x slower than full rate
+#define CPU_FULL_MHZ 240
+#define CPU_SAVE_MHZ 80 // lowest clock WiFi keeps working at
+#define QR_DECODE_STACK (40 * 1024) // quirc_decode keeps ~18 KB of code/data structs on the stack
+#define WIFI_CACHE_MAGIC 0x57464331UL
+#define NETWORK_UP_BIT BIT0
+
+// ---------------------- TIME ----------------------
+uint32_t halMillis()
+{
+  return millis();
+}
+
+uint64_t halMicros()
+{
+  return (uint64_t)esp_timer_get_time();
+}
+
+void halDelayMs(uint32_t ms)
+{
+  vTaskDelay(ms / portTICK_PERIOD_MS);
+}
+
+uint32_t halUnixTime()
+{
+  time_t now = time(NULL);
+  return (uint32_t)now >= CLOCK_VALID_AFTER ? (uint32_t)now : 0;
+}
+
+// ---------------------- LOGGING ----------------------
+void halLog(const char *fmt, ...)
+{
+  char buf[256];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  Serial.print(buf);
+}
+
+// ---------------------- QUEUES / TASKS ----------------------
+static TickType_t toTicks(uint32_t timeoutMs)
+{
+  return timeoutMs == HAL_WAIT_FOREVER ? portMAX_DELAY : timeoutMs / portTICK_PERIOD_MS;
+}
+
+HalQueue halQueueCreate(size_t depth, size_t itemSize)
+{
+  return xQueueCreate(depth, itemSize);
+}
+
+bool halQueueSend(HalQueue queue, const void *item, uint32_t timeoutMs)
+{
+  return xQueueSend((QueueHandle_t)queue, item, toTicks(timeoutMs)) == pdPASS;
+}
+
+bool halQueueReceive(HalQueue queue, void *item, uint32_t timeoutMs)
+{
+  return xQueueReceive((QueueHandle_t)queue, item, toTicks(timeoutMs)) == pdPASS;
+}
+
+HalEvent halEventCreate()
+{
+  return xSemaphoreCreateBinary();
+}
+
+void halEventSignal(HalEvent event)
+{
+  xSemaphoreGive((SemaphoreHandle_t)event);
+}
+
+void HAL_ISR_ATTR halEventSignalFromIsr(HalEvent event)
+{
+  BaseType_t woken = pdFALSE;
+  xSemaphoreGiveFromISR((SemaphoreHandle_t)event, &woken);
+  if (woken)
+    portYIELD_FROM_ISR();
+}
+
+bool halEventWait(HalEvent event, uint32_t timeoutMs)
+{
+  return xSemaphoreTake((SemaphoreHandle_t)event, toTicks(timeoutMs)) == pdTRUE;
+}
+
+HalMutex halMutexCreate()
+{
+  return xSemaphoreCreateMutex();
+}
+
+void halMutexLock(HalMutex mutex)
+{
+  xSemaphoreTake((SemaphoreHandle_t)mutex, portMAX_DELAY);
+}
+
+void halMutexUnlock(HalMutex mutex)
+{
+  xSemaphoreGive((SemaphoreHandle_t)mutex);
+}
+
+// Stack sizes of the tasks created here, for halTaskStats; FreeRTOS only
+// keeps the high-water mark
+struct TaskStack
+{
+  TaskHandle_t handle;
+  uint32_t bytes;
+};
+static TaskStack taskStacks[HAL_MAX_TASKS];
+static int taskStackCount = 0;
+static portMUX_TYPE taskStacksMux = portMUX_INITIALIZER_UNLOCKED;
+
+struct TaskStart
+{
+  HalTaskFn fn;
+  void *arg;
+  uint32_t stackBytes;
+};
+
+// Registers the task's stack, runs it, and deletes the task if fn returns
+static void taskTrampoline(void *p)
+{
+  TaskStart start = *(TaskStart *)p;
+  free(p);
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+  portENTER_CRITICAL(&taskStacksMux);
+  if (taskStackCount < HAL_MAX_TASKS)
+    taskStacks[taskStackCount++] = {self, start.stackBytes};
+  portEXIT_CRITICAL(&taskStacksMux);
+
+  start.fn(start.arg);
+
+  portENTER_CRITICAL(&taskStacksMux);
+  for (int i = 0; i < taskStackCount; i++)
+  {
+    if (taskStacks[i].handle == self)
+    {
+      taskStacks[i] = taskStacks[--taskStackCount];
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&taskStacksMux);
+  vTaskDelete(NULL);
+}
+
+bool halTaskCreate(HalTaskFn fn, const char *name, uint32_t stackBytes, void *arg, int priority, int core)
+{
+  TaskStart *start = (TaskStart *)malloc(sizeof(TaskStart));
+  if (!start)
+    return false;
+  *start = {fn, arg, stackBytes};
+  if (xTaskCreatePinnedToCore(taskTrampoline, name, stackBytes, start, priority, NULL, core) != pdPASS)
+  {
+    free(start);
+    return false;
+  }
+  return true;
+}
+
+// ---------------------- CAMERA ----------------------
+// The sensor is set up here the way ESP32QRCodeReader did it (grayscale QVGA),
+// but with a framebuffer per frame-ring slot plus one for the driver to fill.
+// Frames reach the decode task (core 0) and the debug stream through the
+// ring. qr_decoder skips static scenes and crops to the last code.
+static HalQueue qrQueue;
+static QrDecoder *decoder;
+static bool highResCapable = false; // framebuffers fit VGA
+static camera_config_t cameraConfig;
+static HalMutex sensorLock;                     // sensor registers vs a re-init on the capture task
+static CameraTuning applied = {false, 0, 0xFF}; // nothing set yet
+static int savedClkrc = -1;                     // clock divider before standby, -1 = not in standby
+
+static void decodeTask(void *arg)
+{
+  int subscriber = frameRingSubscribe();
+  uint32_t lastSeq = 0;
+  QrScan scan;
+  while (true)
+  {
+    FrameRef *ref = frameRingAcquire(subscriber, lastSeq, HAL_WAIT_FOREVER);
+    if (!ref)
+      continue;
+    lastSeq = frameRingSeq(ref);
+
+    uint64_t decodeStartUs = halMicros();
+    bool found = qrDecodeFrame(decoder, frameRingFrame(ref), &scan);
+    latencyRecord(LAT_DECODE, decodeStartUs, halMicros());
+    frameRingRelease(ref);
+
+    if (found)
+      halQueueSend(qrQueue, &scan, 0);
+  }
+}
+
+static bool cameraSetup()
+{
+  sensorLock = halMutexCreate();
+  if (!sensorLock)
+    return false;
+
+  camera_config_t &config = cameraConfig;
+  config.pin_pwdn = PWDN_GPIO_NUM;
+  config.pin_reset = RESET_GPIO_NUM;
+  config.pin_xclk = XCLK_GPIO_NUM;
+  config.pin_sccb_sda = SIOD_GPIO_NUM;
+  config.pin_sccb_scl = SIOC_GPIO_NUM;
+  config.pin_d7 = Y9_GPIO_NUM;
+  config.pin_d6 = Y8_GPIO_NUM;
+  config.pin_d5 = Y7_GPIO_NUM;
+  config.pin_d4 = Y6_GPIO_NUM;
+  config.pin_d3 = Y5_GPIO_NUM;
+  config.pin_d2 = Y4_GPIO_NUM;
+  config.pin_d1 = Y3_GPIO_NUM;
+  config.pin_d0 = Y2_GPIO_NUM;
+  config.pin_vsync = VSYNC_GPIO_NUM;
+  config.pin_href = HREF_GPIO_NUM;
+  config.pin_pclk = PCLK_GPIO_NUM;
+  config.xclk_freq_hz = CAMERA_XCLK_HZ;
+  config.ledc_timer = LEDC_TIMER_1;     // timer 0 / channel 0 drive the buzzer
+  config.ledc_channel = LEDC_CHANNEL_2;
+  config.pixel_format = PIXFORMAT_GRAYSCALE;
+  // Four VGA framebuffers only fit in PSRAM
+  highResCapable = CAMERA_AUTO_TUNE && psramFound();
+  config.frame_size = FRAMESIZE_QVGA;
+  config.jpeg_quality = 15;
+  config.fb_count = FRAME_RING_SLOTS + 1;
+  config.fb_location = psramFound() ? CAMERA_FB_IN_PSRAM : CAMERA_FB_IN_DRAM;
+  config.grab_mode = CAMERA_GRAB_LATEST;
+
+  esp_err_t err = esp_camera_init(&config);
+  if (err != ESP_OK)
+  {
+    Serial.printf("Camera init failed: 0x%x\n", err);
+    return false;
+  }
+  return true;
+}
+
+// In raw (grayscale) mode the driver drops every frame whose length isn't
+// the fb_size it allocated at init, so set_framesize() can't switch between
+// QVGA and VGA. The camera is initialized again at the new size instead, on
+// the capture task once every framebuffer has been returned.
+static void cameraReinit()
+{
+  halMutexLock(sensorLock);
+  esp_camera_deinit();
+  esp_err_t err = esp_camera_init(&cameraConfig);
+  if (err != ESP_OK && cameraConfig.frame_size != FRAMESIZE_QVGA)
+  {
+    Serial.printf("Camera re-init failed: 0x%x, back to QVGA\n", err);
+    cameraConfig.frame_size = FRAMESIZE_QVGA;
+    applied.highRes = false;
+    err = esp_camera_init(&cameraConfig);
+  }
+  if (err != ESP_OK)
+    Serial.printf("Camera re-init failed: 0x%x\n", err);
+
+  // The sensor comes back with its defaults: restore the tuning and standby
+  sensor_t *sensor = esp_camera_sensor_get();
+  if (sensor)
+  {
+    sensor->set_ae_level(sensor, applied.aeLevel);
+    if (applied.gainCeiling != 0xFF)
+      sensor->set_gainceiling(sensor, (gainceiling_t)applied.gainCeiling);
+    if (savedClkrc >= 0)
+      sensor->set_reg(sensor, OV2640_REG_CLKRC, 0x3F, OV2640_STANDBY_DIV);
+  }
+  halMutexUnlock(sensorLock);
+}
+
+bool halCameraInit()
+{
+  if (!cameraSetup())
+    return false;
+
+  qrQueue = halQueueCreate(QR_QUEUE_DEPTH, sizeof(QrScan));
+  decoder = qrDecoderCreate();
+  if (!qrQueue || !decoder || !frameRingStart(0))
+    return false;
+  return halTaskCreate(decodeTask, "QR_Decode_Task", QR_DECODE_STACK, NULL, 5, 0); // 🔹 run camera/QR task on Core 0
+}
+
+bool halCameraReceiveQr(QrScan *out, uint32_t timeoutMs)
+{
+  return halQueueReceive(qrQueue, out, timeoutMs);
+}
+
+uint32_t halCameraMotionMs()
+{
+  if (!decoder)
+    return 0;
+  QrDecodeStats stats;
+  qrDecoderStats(decoder, &stats);
+  return stats.motionMs; // frame timestamps are esp_timer time, the same clock as millis()
+}
+
+void halCameraStandby(bool standby)
+{
+  if (!sensorLock)
+    return;
+  halMutexLock(sensorLock);
+  sensor_t *sensor = esp_camera_sensor_get();
+  if (sensor && standby && savedClkrc < 0)
+  {
+    savedClkrc = sensor->get_reg(sensor, OV2640_REG_CLKRC, 0xFF);
+    sensor->set_reg(sensor, OV2640_REG_CLKRC, 0x3F, OV2640_STANDBY_DIV);
+  }
+  else if (sensor && !standby && savedClkrc >= 0)
+  {
+    sensor->set_reg(sensor, OV2640_REG_CLKRC, 0xFF, savedClkrc);
+    savedClkrc = -1;
+  }
+  halMutexUnlock(sensorLock);
+}
+
+void halCameraTune(const CameraTuning *tuning)
+{
+  if (!sensorLock)
+    return;
+  halMutexLock(sensorLock);
+  sensor_t *sensor = esp_camera_sensor_get();
+  bool resize = false;
+  if (sensor)
+  {
+    if (tuning->aeLevel != applied.aeLevel)
+      sensor->set_ae_level(sensor, tuning->aeLevel);
+    if (tuning->gainCeiling != applied.gainCeiling)
+      sensor->set_gainceiling(sensor, (gainceiling_t)tuning->gainCeiling);
+    resize = tuning->highRes != applied.highRes && highResCapable;
+    if (resize)
+      cameraConfig.frame_size = tuning->highRes ? FRAMESIZE_VGA : FRAMESIZE_QVGA;
+    applied = *tuning;
+  }
+  halMutexUnlock(sensorLock);
+
+  if (resize)
+    frameRingReconfigure(cameraReinit);
+}
+
+void halCameraDecodeStats(QrDecodeStats *out)
+{
+  if (decoder)
+    qrDecoderStats(decoder, out);
+  else
+    memset(out, 0, sizeof(*out));
+}
+
+bool halCameraFrameGet(HalFrame *frame)
+{
+  camera_fb_t *fb = esp_camera_fb_get();
+  if (!fb)
+    return false;
+
+  frame->buf = fb->buf;
+  frame->len = fb->len;
+  frame->width = fb->width;
+  frame->height = fb->height;
+  frame->timestampUs = (uint64_t)fb->timestamp.tv_sec * 1000000ULL + fb->timestamp.tv_usec; // esp_timer time at capture
+  frame->priv = fb;
+  return true;
+}
+
+void halCameraFrameReturn(HalFrame *frame)
+{
+  if (frame->priv)
+    esp_camera_fb_return((camera_fb_t *)frame->priv);
+  frame->priv = NULL;
+  frame->buf = NULL;
+}
+
+bool halCameraEncodeJpeg(const HalFrame *frame, int quality, uint8_t **jpeg, size_t *len)
+{
+  return fmt2jpg((uint8_t *)frame->buf, frame->len, frame->width, frame->height, PIXFORMAT_GRAYSCALE, quality, jpeg, len);
+}
+
+// ---------------------- NETWORK ----------------------
+// The access point, channel and address of the last connection are kept in
+// RTC memory, which survives deep sleep. After a wake they are tried for
+// WIFI_FAST_CONNECT_MS before falling back to a full scan and DHCP.
+struct WifiCache
+{
+  uint32_t magic;
+  uint8_t bssid[6];
+  int32_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint32_t sleptUnix; // when deep sleep started, 0 = unknown
+};
+
+RTC_DATA_ATTR static WifiCache wifiCache;
+static EventGroupHandle_t networkEvents;
+
+static bool waitConnected(uint32_t timeoutMs)
+{
+  uint32_t startMs = millis();
+  while (WiFi.status() != WL_CONNECTED)
+  {
+    if (timeoutMs != HAL_WAIT_FOREVER && millis() - startMs >= timeoutMs)
+      return false;
+    delay(20);
+  }
+  return true;
+}
+
+static void networkTask(void *arg)
+{
+  uint32_t startMs = millis();
+  WiFi.mode(WIFI_STA);
+
+  bool fast = wifiCache.magic == WIFI_CACHE_MAGIC;
+  if (fast)
+  {
+    // The DHCP lease outlives a short sleep; after a long one, ask again
+    uint32_t now = halUnixTime();
+    if (wifiCache.sleptUnix != 0 && now != 0 && now - wifiCache.sleptUnix < WIFI_REUSE_IP_S)
+      WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway), IPAddress(wifiCache.subnet),
+                  IPAddress(wifiCache.dns));
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD, wifiCache.channel, wifiCache.bssid);
+    fast = waitConnected(WIFI_FAST_CONNECT_MS);
+    if (!fast)
+    {
+      Serial.println("WiFi: cached access point didn't answer, scanning");
+      WiFi.disconnect();
+      WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE); // back to DHCP
+    }
+  }
+  if (!fast)
+  {
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    waitConnected(HAL_WAIT_FOREVER);
+  }
+  Serial.printf("WiFi connected in %lu ms%s, IP %s\n", (unsigned long)(millis() - startMs),
+                fast ? " (fast resume)" : "", WiFi.localIP().toString().c_str());
+
+  wifiCache.magic = WIFI_CACHE_MAGIC;
+  memcpy(wifiCache.bssid, WiFi.BSSID(), sizeof(wifiCache.bssid));
+  wifiCache.channel = WiFi.channel();
+  wifiCache.ip = (uint32_t)WiFi.localIP();
+  wifiCache.gateway = (uint32_t)WiFi.gatewayIP();
+  wifiCache.subnet = (uint32_t)WiFi.subnetMask();
+  wifiCache.dns = (uint32_t)WiFi.dnsIP();
+  wifiCache.sleptUnix = 0;
+
+  // Wall clock for access cache TTLs and signed-payload expiry. The RTC
+  // keeps time through deep sleep, so cached grants work before this syncs.
+  configTime(0, 0, NTP_SERVER);
+  xEventGroupSetBits(networkEvents, NETWORK_UP_BIT);
+}
+
+void halNetworkBegin()
+{
+  networkEvents = xEventGroupCreate();
+  if (!networkEvents || !halTaskCreate(networkTask, "Network_Task", 4096, NULL, 2, 0))
+    Serial.println("ERROR: network task creation failed");
+}
+
+bool halNetworkWait(uint32_t timeoutMs)
+{
+  if (!networkEvents)
+    return false;
+  EventBits_t bits = xEventGroupWaitBits(networkEvents, NETWORK_UP_BIT, pdFALSE, pdTRUE, toTicks(timeoutMs));
+  return (bits & NETWORK_UP_BIT) && WiFi.status() == WL_CONNECTED;
+}
+
+// ---------------------- HTTP ----------------------
+// The access server is the same host for every QR, so each client's
+// HTTPClient runs with setReuse(true) and keeps its TCP/TLS connection open
+// between scans, only handshaking again after the link drops.
+struct HalHttpClient
+{
+  WiFiClient plain;
+  WiFiClientSecure secure;
+  HTTPClient http;
+  char origin[128]; // scheme://host:port the transports point at
+};
+
+// Splits an http(s) URL into host and port
+static bool parseUrl(const char *url, char *host, size_t hostLen, uint16_t *port, bool *https)
+{
+  *https = strncmp(url, "https://", 8) == 0;
+  if (!*https && strncmp(url, "http://", 7) != 0)
+    return false;
+
+  const char *hostStart = url + (*https ? 8 : 7);
+  size_t len = strcspn(hostStart, ":/?");
+  if (len == 0 || len >= hostLen)
+    return false;
+  memcpy(host, hostStart, len);
+  host[len] = '\0';
+  *port = hostStart[len] == ':' ? (uint16_t)atoi(hostStart + len + 1) : (*https ? 443 : 80);
+  return true;
+}
+
+// Returns the transport for url's origin, dropping any connection to another one
+static WiFiClient *transportFor(HalHttpClient *client, const char *url, char *host, size_t hostLen, uint16_t *port)
+{
+  bool https;
+  if (!parseUrl(url, host, hostLen, port, &https))
+    return NULL;
+
+  char origin[sizeof(client->origin)];
+  snprintf(origin, sizeof(origin), "%s://%s:%u", https ? "https" : "http", host, *port);
+  if (strcmp(origin, client->origin) != 0)
+  {
+    client->plain.stop();
+    client->secure.stop();
+    strcpy(client->origin, origin);
+  }
+  return https ? (WiFiClient *)&client->secure : &client->plain;
+}
+
+HalHttpClient *halHttpClientCreate()
+{
+  HalHttpClient *client = new HalHttpClient();
+  client->origin[0] = '\0';
+#ifdef ACCESS_SERVER_CA
+  client->secure.setCACert(ACCESS_SERVER_CA);
+#else
+  client->secure.setInsecure(); // what HTTPClient::begin(url) did without a CA
+#endif
+  return client;
+}
+
+// Collects writeToStream() output in a fixed buffer, dropping what doesn't fit
+class FixedBufferStream : public Stream
+{
+public:
+  FixedBufferStream(char *buf, size_t cap) : buf(buf), cap(cap), len(0) {}
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t n) override
+  {
+    size_t keep = n < cap - len ? n : cap - len;
+    memcpy(buf + len, data, keep);
+    len += keep;
+    return n;
+  }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  size_t length() const { return len; }
+
+private:
+  char *buf;
+  size_t cap;
+  size_t len;
+};
+
+// Reads the response body into body without building a String. With a
+// Content-Length it is read straight off the socket and the part that
+// doesn't fit is discarded, keeping the kept-alive connection in sync.
+// Chunked replies go through writeToStream(), which undoes the chunking
+// (HTTPClient allocates its own copy buffer on that path).
+static void readBody(HTTPClient &http, char *body, size_t bodyLen)
+{
+  if (bodyLen == 0)
+    return;
+
+  size_t len = 0;
+  int size = http.getSize();
+  if (size >= 0)
+  {
+    WiFiClient *stream = http.getStreamPtr();
+    size_t keep = (size_t)size < bodyLen - 1 ? (size_t)size : bodyLen - 1;
+    len = stream->readBytes(body, keep);
+    int rest = size - (int)len;
+    uint8_t scratch[64];
+    while (rest > 0)
+    {
+      int n = stream->readBytes(scratch, rest < (int)sizeof(scratch) ? rest : (int)sizeof(scratch));
+      if (n <= 0)
+        break;
+      rest -= n;
+    }
+  }
+  else
+  {
+    FixedBufferStream sink(body, bodyLen - 1);
+    http.writeToStream(&sink);
+    len = sink.length();
+  }
+  body[len] = '\0';
+}
+
+// GET when contentType is NULL, else a POST of data
+static int httpRequest(HalHttpClient *client, const char *url, const char *contentType, const uint8_t *data,
+                       size_t len, char *body, size_t bodyLen, uint32_t timeoutMs)
+{
+  if (bodyLen > 0)
+    body[0] = '\0';
+
+  char host[96];
+  uint16_t port;
+  WiFiClient *transport = transportFor(client, url, host, sizeof(host), &port);
+  if (!transport)
+  {
+    Serial.printf("HTTP failed: unsupported URL %s\n", url);
+    return 0;
+  }
+
+  // A kept-alive connection may have been closed by the server since the
+  // last request; retry once on a fresh connection in that case
+  HTTPClient &http = client->http;
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    bool reused = transport->connected();
+    http.begin(*transport, url);
+    http.setReuse(true);
+    http.setConnectTimeout(timeoutMs);
+    http.setTimeout(timeoutMs);
+
+    int httpCode;
+    if (contentType)
+    {
+      http.addHeader("Content-Type", contentType);
+      httpCode = http.POST((uint8_t *)data, len);
+    }
+    else
+    {
+      httpCode = http.GET();
+    }
+    if (httpCode > 0)
+    {
+      readBody(http, body, bodyLen);
+      http.end(); // keeps the connection unless the server asked to close
+      return httpCode;
+    }
+
+    Serial.printf("HTTP failed: error %d\n", httpCode); // HTTPC_ERROR_*; errorToString() builds a String
+    http.end();
+    transport->stop();
+    if (!reused)
+      break;
+  }
+  return 0;
+}
+
+int halHttpGet(HalHttpClient *client, const char *url, char *body, size_t bodyLen, uint32_t timeoutMs)
+{
+  return httpRequest(client, url, NULL, NULL, 0, body, bodyLen, timeoutMs);
+}
+
+int halHttpPost(HalHttpClient *client, const char *url, const char *contentType, const uint8_t *data, size_t len,
+                char *body, size_t bodyLen, uint32_t timeoutMs)
+{
+  return httpRequest(client, url, contentType, data, len, body, bodyLen, timeoutMs);
+}
+
+bool halHttpWarmup(HalHttpClient *client, const char *url)
+{
+  char host[96];
+  uint16_t port;
+  WiFiClient *transport = transportFor(client, url, host, sizeof(host), &port);
+  if (!transport)
+    return false;
+  if (transport->connected())
+    return true;
+  if (WiFi.status() != WL_CONNECTED)
+    return false;
+  return transport->connect(host, port);
+}
+
+// ---------------------- CRYPTO ----------------------
+void halSha256(const uint8_t *data, size_t len, uint8_t out[32])
+{
+  mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), data, len, out);
+}
+
+void halHmacSha256(const uint8_t *key, size_t keyLen, const uint8_t *data, size_t len, uint8_t out[32])
+{
+  mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), key, keyLen, data, len, out);
+}
+
+// ---------------------- MEMORY / STORAGE ----------------------
+void *halAllocLarge(size_t size)
+{
+  void *p = psramFound() ? ps_calloc(1, size) : NULL;
+  return p ? p : calloc(1, size);
+}
+
+bool halStorageLoad(const char *key, void *buf, size_t len)
+{
+  Preferences prefs;
+  if (!prefs.begin(STORAGE_NAMESPACE, true))
+    return false;
+  bool ok = prefs.getBytesLength(key) == len && prefs.getBytes(key, buf, len) == len;
+  prefs.end();
+  return ok;
+}
+
+bool halStorageSave(const char *key, const void *buf, size_t len)
+{
+  Preferences prefs;
+  if (!prefs.begin(STORAGE_NAMESPACE, false))
+    return false;
+  bool ok = prefs.putBytes(key, buf, len) == len;
+  prefs.end();
+  return ok;
+}
+
+// The audit log takes the data partition huge_app.csv labels "spiffs";
+// nothing mounts a filesystem there.
+static const esp_partition_t *auditPartition()
+{
+  static const esp_partition_t *partition =
+      esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "spiffs");
+  return partition;
+}
+
+size_t halAuditRegionSize()
+{
+  const esp_partition_t *partition = auditPartition();
+  return partition ? partition->size / HAL_AUDIT_SECTOR_BYTES * HAL_AUDIT_SECTOR_BYTES : 0;
+}
+
+bool halAuditRegionRead(size_t offset, void *buf, size_t len)
+{
+  const esp_partition_t *partition = auditPartition();
+  return partition && esp_partition_read(partition, offset, buf, len) == ESP_OK;
+}
+
+bool halAuditRegionWrite(size_t offset, const void *buf, size_t len)
+{
+  const esp_partition_t *partition = auditPartition();
+  return partition && esp_partition_write(partition, offset, buf, len) == ESP_OK;
+}
+
+bool halAuditRegionErase(size_t sector)
+{
+  const esp_partition_t *partition = auditPartition();
+  return partition &&
+         esp_partition_erase_range(partition, sector * HAL_AUDIT_SECTOR_BYTES, HAL_AUDIT_SECTOR_BYTES) == ESP_OK;
+}
+
+// ---------------------- DIAGNOSTICS ----------------------
+// Needs configUSE_TRACE_FACILITY; runtimes also need
+// configGENERATE_RUN_TIME_STATS (both on in the Arduino-ESP32 build).
+size_t halTaskStats(HalTaskStat *out, size_t max, uint32_t *totalRuntime)
+{
+  static TaskStatus_t status[HAL_MAX_TASKS]; // too big for the caller's stack
+  uint32_t total = 0;
+  size_t n = uxTaskGetSystemState(status, HAL_MAX_TASKS, &total);
+  if (n > max)
+    n = max;
+
+  for (size_t i = 0; i < n; i++)
+  {
+    HalTaskStat *stat = &out[i];
+    snprintf(stat->name, sizeof(stat->name), "%s", status[i].pcTaskName);
+    stat->id = status[i].xTaskNumber;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    BaseType_t core = xTaskGetCoreID(status[i].xHandle);
+#else
+    BaseType_t core = xTaskGetAffinity(status[i].xHandle);
+#endif
+    stat->core = core == tskNO_AFFINITY ? -1 : (int)core;
+    stat->priority = status[i].uxCurrentPriority;
+    stat->runtime = status[i].ulRunTimeCounter;
+    stat->stackMinFree = status[i].usStackHighWaterMark; // bytes: ESP-IDF stacks are byte-sized
+
+    stat->stackBytes = 0;
+    portENTER_CRITICAL(&taskStacksMux);
+    for (int t = 0; t < taskStackCount; t++)
+    {
+      if (taskStacks[t].handle == status[i].xHandle)
+        stat->stackBytes = taskStacks[t].bytes;
+    }
+    portEXIT_CRITICAL(&taskStacksMux);
+  }
+  *totalRuntime = total;
+  return n;
+}
+
+size_t halHeapStats(HalHeapStat *out, size_t max)
+{
+  static const struct
+  {
+    const char *name;
+    uint32_t caps;
+  } heaps[] = {{"internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT}, {"psram", MALLOC_CAP_SPIRAM}};
+
+  size_t n = 0;
+  for (size_t i = 0; i < sizeof(heaps) / sizeof(heaps[0]) && n < max; i++)
+  {
+    size_t total = heap_caps_get_total_size(heaps[i].caps);
+    if (total == 0)
+      continue; // no PSRAM fitted
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, heaps[i].caps);
+    out[n].name = heaps[i].name;
+    out[n].totalBytes = total;
+    out[n].freeBytes = info.total_free_bytes;
+    out[n].largestFreeBlock = info.largest_free_block;
+    out[n].minFreeBytes = info.minimum_free_bytes;
+    n++;
+  }
+  return n;
+}
+
+// ---------------------- GPIO / POWER ----------------------
+// Initialize buzzer PWM channel, attach pin - call this once in setup()
+void halToneInit()
+{
+  ledcSetup(BUZZER_CHANNEL, BUZZER_FREQ, BUZZER_RES);
+  ledcAttachPin(BUZZER_PIN, BUZZER_CHANNEL);
+  ledcWriteTone(BUZZER_CHANNEL, 0); // start silent
+}
+
+void halToneWrite(uint32_t frequency)
+{
+  ledcWriteTone(BUZZER_CHANNEL, frequency);
+}
+
+void halLockInit()
+{
+  pinMode(LOCK_PIN, OUTPUT);
+  digitalWrite(LOCK_PIN, LOW);
+}
+
+void halLockWrite(bool open)
+{
+  digitalWrite(LOCK_PIN, open ? HIGH : LOW);
+}
+
+void halButtonInit()
+{
+  pinMode(RESTART_BUTTON_PIN, INPUT_PULLDOWN);
+#if MOTION_WAKE_PIN >= 0
+  pinMode(MOTION_WAKE_PIN, INPUT_PULLDOWN);
+#endif
+}
+
+void halButtonOnPress(HalIsrFn onPress)
+{
+  // With a pull-down resistor, a press is a rising edge
+  attachInterrupt(digitalPinToInterrupt(RESTART_BUTTON_PIN), onPress, RISING);
+}
+
+void halRestart()
+{
+  ESP.restart();
+}
+
+// The camera's XCLK and DMA stop in light sleep, so the CPU is only slowed
+// down; FreeRTOS idles it between frames either way
+void halPowerSave(bool enable)
+{
+  setCpuFrequencyMhz(enable ? CPU_SAVE_MHZ : CPU_FULL_MHZ);
+  WiFi.setSleep(enable ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+}
+
+void halDeepSleep()
+{
+  // Place the wake-up code here before going to sleep
+  const gpio_num_t wakeUpPin = (gpio_num_t)RESTART_BUTTON_PIN; // GPIO pin for button
+  uint64_t wakeMask = 1ULL << wakeUpPin;
+#if MOTION_WAKE_PIN >= 0
+  wakeMask |= 1ULL << MOTION_WAKE_PIN; // PIR output, high on motion
+#endif
+  esp_sleep_enable_ext1_wakeup(wakeMask, ESP_EXT1_WAKEUP_ANY_HIGH);
+  wifiCache.sleptUnix = halUnixTime(); // decides whether the address is reused on wake
+
+  // Go into deep sleep
+  esp_deep_sleep_start();
+}
@@ -0,0 +1,71 @@
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "hal_native.h"
+
+// Counts heap allocations made by pipeline task threads, by interposing the
+// malloc family over glibc's. The counters are checked before anything else
+// is done, so the cost while counting is off is one atomic load per call.
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+
+static std::atomic<bool> counting(false);
+static std::atomic<uint64_t> allocations(0);
+static thread_local bool taskThread = false;
+
+static inline void noteAllocation()
+{
+  if (counting.load(std::memory_order_relaxed) && taskThread)
+    allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" void *malloc(size_t size)
+{
+  noteAllocation();
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+  noteAllocation();
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+  noteAllocation();
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+  noteAllocation();
+  return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+  noteAllocation();
+  *ptr = __libc_memalign(alignment, size);
+  return *ptr ? 0 : 12; // ENOMEM
+}
+
+void halNativeMarkTaskThread()
+{
+  taskThread = true;
+}
+
+void halNativeCountAllocs(bool enable)
+{
+  if (enable)
+    allocations.store(0, std::memory_order_relaxed);
+  counting.store(enable, std::memory_order_relaxed);
+}
+
+uint64_t halNativeAllocCount()
+{
+  return allocations.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "app.h"
+#include "buzzer.h"
+#include "config.h"
+#include "hal.h"
+#include "hal_native.h"
+#include "http_standin.h"
+#include "latency.h"
+#include "lcd.h"
+#include "tools.h"
+
+// Scan-to-unlock benchmark. Runs the real pipeline on the host, presents a
+// QR to the camera once per run (a recorded frame, or an injected decode
+// result when no frames are given), validates it against the local HTTP
+// stand-in and waits for the lock to open. Reports p50/p95/p99 per stage.
+// With --check-allocs it first warms up every validation worker's
+// connection, then counts heap allocations on the pipeline's tasks over the
+// runs and fails if there are any.
+
+#define BENCH_UNLOCK_TIMEOUT_MS 20000 // give up on a run after this long
+#define BENCH_POLL_MS 1               // lock pin sampling period
+
+static bool waitForLock(bool open, uint32_t timeoutMs)
+{
+  uint32_t start = halMillis();
+  while (halNativeLockOpen() != open)
+  {
+    if (halMillis() - start > timeoutMs)
+      return false;
+    halDelayMs(BENCH_POLL_MS);
+  }
+  return true;
+}
+
+static void printReport(int runs, int unlocked, bool standin)
+{
+  printf("\nscan-to-unlock benchmark: %d runs, %d unlocked\n", runs, unlocked);
+  if (standin)
+    printf("HTTP connections opened: %u\n", (unsigned)httpStandinConnections());
+  QrDecodeStats decode;
+  halCameraDecodeStats(&decode);
+  printf("frames: %u captured, %u skipped (static scene), %u skipped (no finder pattern), %u cropped to the last code\n",
+         (unsigned)decode.frames, (unsigned)decode.skipped, (unsigned)decode.noFinder, (unsigned)decode.cropped);
+  printf("%-16s %6s %10s %10s %10s %10s\n", "stage", "count", "p50_ms", "p95_ms", "p99_ms", "max_ms");
+  for (int i = 0; i < LAT_STAGE_COUNT; i++)
+  {
+    LatencySummary summary;
+    latencySummarize((LatencyStage)i, &summary);
+    printf("%-16s %6zu %10.2f %10.2f %10.2f %10.2f\n", latencyStageName((LatencyStage)i), summary.count,
+           summary.p50Us / 1000.0, summary.p95Us / 1000.0, summary.p99Us / 1000.0, summary.maxUs / 1000.0);
+  }
+}
+
+int benchMain(int argc, char **argv)
+{
+  int runs = 20;
+  const char *server = NULL;
+  uint32_t serverDelayMs = 0;
+  bool checkAllocs = false;
+  std::vector<int> frames;
+
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+      runs = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc)
+      server = argv[++i];
+    else if (strcmp(argv[i], "--server-delay-ms") == 0 && i + 1 < argc)
+      serverDelayMs = (uint32_t)strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--check-allocs") == 0)
+      checkAllocs = true;
+    else if (argv[i][0] == '-')
+      return 2;
+    else
+    {
+      int index = halNativeLoadFrame(argv[i]);
+      if (index < 0)
+      {
+        fprintf(stderr, "bench: cannot load frame %s\n", argv[i]);
+        return 1;
+      }
+      frames.push_back(index);
+    }
+  }
+
+  char standin[32];
+  if (!server)
+  {
+    int port = httpStandinStart();
+    if (port < 0)
+    {
+      fprintf(stderr, "bench: cannot start HTTP stand-in\n");
+      return 1;
+    }
+    httpStandinSetDelayMs(serverDelayMs);
+    snprintf(standin, sizeof(standin), "127.0.0.1:%d", port);
+    server = standin;
+  }
+  halNativeSetHttpOverride(server);
+  halNativeSetQuiet(true);
+
+  lcdInit();
+  buzzerInit();
+  halLockInit();
+  if (!halCameraInit() || !appStart())
+    return 1;
+  appReady();
+  halDelayMs(1000); // let the startup jingle finish
+
+  if (checkAllocs)
+  {
+    // Opening a connection allocates (name lookup), so open them all first:
+    // with the stand-in slowed down, back-to-back scans land on different
+    // workers. This also fills any lazily allocated buffers.
+    if (server == standin)
+      httpStandinSetDelayMs(serverDelayMs + 200);
+    for (int worker = 0; worker < VALIDATION_WORKERS; worker++)
+    {
+      char payload[64];
+      snprintf(payload, sizeof(payload), "http://bench/ok?warmup=%d", worker);
+      halNativeInjectQr(payload, true);
+      halDelayMs(20);
+    }
+    waitForLock(true, BENCH_UNLOCK_TIMEOUT_MS);
+    halDelayMs(VALIDATION_WORKERS * 200 + 100);
+    waitForLock(false, LOCK_UNLOCK_DURATION_MS + 1000);
+    if (server == standin)
+      httpStandinSetDelayMs(serverDelayMs);
+    halNativeCountAllocs(true);
+  }
+
+  latencyReset();
+  int unlocked = 0;
+  for (int run = 0; run < runs; run++)
+  {
+    uint32_t startMs = halMillis();
+    if (frames.empty())
+    {
+      char payload[64];
+      snprintf(payload, sizeof(payload), "http://bench/ok?run=%d", run);
+      halNativeInjectQr(payload, true);
+    }
+    else
+    {
+      halNativeShowFrame(frames[run % frames.size()]);
+    }
+
+    bool ok = waitForLock(true, BENCH_UNLOCK_TIMEOUT_MS);
+    halNativeShowFrame(-1);
+    if (ok)
+      unlocked++;
+    fprintf(stderr, "run %d/%d: %s\n", run + 1, runs, ok ? "unlocked" : "timed out");
+
+    // Wait for relock, then for the payload debounce when frames repeat
+    waitForLock(false, LOCK_UNLOCK_DURATION_MS + 1000);
+    if (!frames.empty())
+    {
+      uint32_t elapsedMs = halMillis() - startMs;
+      if (elapsedMs < QR_DEBOUNCE_MS + 500)
+        halDelayMs(QR_DEBOUNCE_MS + 500 - elapsedMs);
+    }
+  }
+
+  printReport(runs, unlocked, server == standin);
+  if (checkAllocs)
+  {
+    halNativeCountAllocs(false);
+    uint64_t allocs = halNativeAllocCount();
+    printf("heap allocations on pipeline tasks: %llu over %d scans\n", (unsigned long long)allocs, runs);
+    if (allocs > 0)
+      return 1;
+  }
+  return unlocked == runs ? 0 : 1;
+}
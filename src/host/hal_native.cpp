@@ -0,0 +1,967 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <deque>
+#include <vector>
+#include "config.h"
+#include "frame_ring.h"
+#include "hal.h"
+#include "hal_native.h"
+#include "latency.h"
+#include "qr_decoder.h"
+
+#define NATIVE_MIN_STACK (256 * 1024) // host libc needs far more than the device stacks
+#define NATIVE_STACK_FILL 0xA5        // untouched stack bytes, for the high-water mark
+#define NATIVE_QR_QUEUE_DEPTH 4
+#define NATIVE_FRAME_WIDTH 320        // QVGA, the reader's default frame size
+#define NATIVE_FRAME_HEIGHT 240
+#define NATIVE_FRAME_INTERVAL_MS 40   // ~25 fps grayscale from the OV2640
+#define NATIVE_AUDIT_REGION_BYTES (16 * HAL_AUDIT_SECTOR_BYTES) // audit log ring, 64 KB
+
+static pthread_mutex_t logMutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool logQuiet = false;
+
+static volatile bool lockOpen = false;
+static HalIsrFn buttonIsr = NULL;
+static volatile uint32_t toneFrequency = 0;
+static char httpOverride[64] = "";
+
+// ---------------------- TIME ----------------------
+static uint64_t monotonicUs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static const uint64_t bootUs = monotonicUs();
+
+uint32_t halMillis()
+{
+  return (uint32_t)((monotonicUs() - bootUs) / 1000);
+}
+
+uint64_t halMicros()
+{
+  return monotonicUs() - bootUs;
+}
+
+void halDelayMs(uint32_t ms)
+{
+  struct timespec ts = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+  while (nanosleep(&ts, &ts) != 0)
+  {
+  }
+}
+
+uint32_t halUnixTime()
+{
+  return (uint32_t)time(NULL);
+}
+
+// ---------------------- LOGGING ----------------------
+void halLog(const char *fmt, ...)
+{
+  if (logQuiet)
+    return;
+
+  va_list args;
+  va_start(args, fmt);
+  pthread_mutex_lock(&logMutex);
+  vprintf(fmt, args);
+  fflush(stdout);
+  pthread_mutex_unlock(&logMutex);
+  va_end(args);
+}
+
+void halNativeSetQuiet(bool quiet)
+{
+  logQuiet = quiet;
+}
+
+// ---------------------- QUEUES / TASKS ----------------------
+struct NativeQueue
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t notEmpty;
+  pthread_cond_t notFull;
+  uint8_t *items;
+  size_t depth;
+  size_t itemSize;
+  size_t head;
+  size_t count;
+};
+
+static void deadlineAfter(struct timespec *ts, uint32_t timeoutMs)
+{
+  clock_gettime(CLOCK_MONOTONIC, ts);
+  ts->tv_sec += timeoutMs / 1000;
+  ts->tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+  if (ts->tv_nsec >= 1000000000L)
+  {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000L;
+  }
+}
+
+// Waits on cond until pred() holds or the timeout expires. Mutex is held.
+template <typename Pred>
+static bool waitFor(NativeQueue *q, pthread_cond_t *cond, uint32_t timeoutMs, Pred pred)
+{
+  if (pred())
+    return true;
+  if (timeoutMs == 0)
+    return false;
+
+  struct timespec deadline;
+  if (timeoutMs != HAL_WAIT_FOREVER)
+    deadlineAfter(&deadline, timeoutMs);
+
+  while (!pred())
+  {
+    if (timeoutMs == HAL_WAIT_FOREVER)
+      pthread_cond_wait(cond, &q->mutex);
+    else if (pthread_cond_timedwait(cond, &q->mutex, &deadline) != 0)
+      return pred();
+  }
+  return true;
+}
+
+HalQueue halQueueCreate(size_t depth, size_t itemSize)
+{
+  NativeQueue *q = (NativeQueue *)calloc(1, sizeof(NativeQueue));
+  if (!q)
+    return NULL;
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_mutex_init(&q->mutex, NULL);
+  pthread_cond_init(&q->notEmpty, &attr);
+  pthread_cond_init(&q->notFull, &attr);
+  pthread_condattr_destroy(&attr);
+
+  q->items = (uint8_t *)malloc(depth * itemSize);
+  q->depth = depth;
+  q->itemSize = itemSize;
+  return q;
+}
+
+bool halQueueSend(HalQueue queue, const void *item, uint32_t timeoutMs)
+{
+  NativeQueue *q = (NativeQueue *)queue;
+  pthread_mutex_lock(&q->mutex);
+  bool ok = waitFor(q, &q->notFull, timeoutMs, [q]
+                    { return q->count < q->depth; });
+  if (ok)
+  {
+    size_t tail = (q->head + q->count) % q->depth;
+    memcpy(q->items + tail * q->itemSize, item, q->itemSize);
+    q->count++;
+    pthread_cond_signal(&q->notEmpty);
+  }
+  pthread_mutex_unlock(&q->mutex);
+  return ok;
+}
+
+bool halQueueReceive(HalQueue queue, void *item, uint32_t timeoutMs)
+{
+  NativeQueue *q = (NativeQueue *)queue;
+  pthread_mutex_lock(&q->mutex);
+  bool ok = waitFor(q, &q->notEmpty, timeoutMs, [q]
+                    { return q->count > 0; });
+  if (ok)
+  {
+    memcpy(item, q->items + q->head * q->itemSize, q->itemSize);
+    q->head = (q->head + 1) % q->depth;
+    q->count--;
+    pthread_cond_signal(&q->notFull);
+  }
+  pthread_mutex_unlock(&q->mutex);
+  return ok;
+}
+
+// Events are depth-1 queues whose count is the latched flag
+HalEvent halEventCreate()
+{
+  return halQueueCreate(1, 1);
+}
+
+void halEventSignal(HalEvent event)
+{
+  NativeQueue *q = (NativeQueue *)event;
+  pthread_mutex_lock(&q->mutex);
+  q->count = 1;
+  pthread_cond_signal(&q->notEmpty);
+  pthread_mutex_unlock(&q->mutex);
+}
+
+void halEventSignalFromIsr(HalEvent event)
+{
+  halEventSignal(event);
+}
+
+bool halEventWait(HalEvent event, uint32_t timeoutMs)
+{
+  uint8_t token;
+  return halQueueReceive(event, &token, timeoutMs);
+}
+
+HalMutex halMutexCreate()
+{
+  pthread_mutex_t *mutex = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
+  if (mutex)
+    pthread_mutex_init(mutex, NULL);
+  return mutex;
+}
+
+void halMutexLock(HalMutex mutex)
+{
+  pthread_mutex_lock((pthread_mutex_t *)mutex);
+}
+
+void halMutexUnlock(HalMutex mutex)
+{
+  pthread_mutex_unlock((pthread_mutex_t *)mutex);
+}
+
+struct TaskStart
+{
+  HalTaskFn fn;
+  void *arg;
+};
+
+// Every task's thread and stack, for halTaskStats. Stacks are allocated here
+// and painted so their high-water mark can be found the way FreeRTOS does.
+struct NativeTask
+{
+  char name[16];
+  pthread_t thread;
+  int core;
+  int priority;
+  uint8_t *stack;
+  size_t stackBytes;
+};
+
+static NativeTask tasks[HAL_MAX_TASKS];
+static size_t taskCount = 0;
+static pthread_mutex_t taskMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *taskTrampoline(void *p)
+{
+  TaskStart start = *(TaskStart *)p;
+  free(p);
+  halNativeMarkTaskThread();
+  start.fn(start.arg);
+  return NULL;
+}
+
+// Priority and core are only recorded for halTaskStats; threads float
+bool halTaskCreate(HalTaskFn fn, const char *name, uint32_t stackBytes, void *arg, int priority, int core)
+{
+  size_t size = stackBytes < NATIVE_MIN_STACK ? NATIVE_MIN_STACK : stackBytes;
+  size = (size + 4095) & ~(size_t)4095;
+  TaskStart *start = (TaskStart *)malloc(sizeof(TaskStart));
+  uint8_t *stack = (uint8_t *)aligned_alloc(4096, size);
+  if (!start || !stack)
+  {
+    free(start);
+    free(stack);
+    return false;
+  }
+  start->fn = fn;
+  start->arg = arg;
+  memset(stack, NATIVE_STACK_FILL, size);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, stack, size);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  pthread_t thread;
+  int err = pthread_create(&thread, &attr, taskTrampoline, start);
+  pthread_attr_destroy(&attr);
+  if (err != 0)
+  {
+    free(start);
+    free(stack);
+    return false;
+  }
+  char shortName[16];
+  snprintf(shortName, sizeof(shortName), "%s", name);
+  pthread_setname_np(thread, shortName);
+
+  pthread_mutex_lock(&taskMutex);
+  if (taskCount < HAL_MAX_TASKS)
+  {
+    NativeTask *task = &tasks[taskCount++];
+    memcpy(task->name, shortName, sizeof(task->name));
+    task->thread = thread;
+    task->core = core;
+    task->priority = priority;
+    task->stack = stack;
+    task->stackBytes = size;
+  }
+  pthread_mutex_unlock(&taskMutex);
+  return true;
+}
+
+// ---------------------- CAMERA ----------------------
+// Mirrors the device: the frame ring's capture task grabs whatever frame is
+// in view at the sensor rate, and the decode task runs qr_decoder over the
+// newest one and queues any result for halCameraReceiveQr().
+struct NativeFrame
+{
+  std::vector<uint8_t> pixels;
+  uint16_t width;
+  uint16_t height;
+};
+
+static HalQueue qrQueue;
+static QrDecoder *decoder;
+static std::deque<NativeFrame> frames; // deque keeps shown frames stable while loading
+static NativeFrame emptyScene;
+static int shownFrame = -1;
+static uint64_t lastCaptureUs = 0;
+static pthread_mutex_t frameMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void decodeTask(void *arg)
+{
+  (void)arg;
+  int subscriber = frameRingSubscribe();
+  uint32_t lastSeq = 0;
+  QrScan scan;
+  while (true)
+  {
+    FrameRef *ref = frameRingAcquire(subscriber, lastSeq, HAL_WAIT_FOREVER);
+    if (!ref)
+      continue;
+    lastSeq = frameRingSeq(ref);
+
+    uint64_t decodeStartUs = halMicros();
+    bool found = qrDecodeFrame(decoder, frameRingFrame(ref), &scan);
+    latencyRecord(LAT_DECODE, decodeStartUs, halMicros());
+    frameRingRelease(ref);
+
+    if (found)
+      halQueueSend(qrQueue, &scan, 0);
+  }
+}
+
+bool halCameraInit()
+{
+  if (qrQueue)
+    return true;
+
+  emptyScene.width = NATIVE_FRAME_WIDTH;
+  emptyScene.height = NATIVE_FRAME_HEIGHT;
+  emptyScene.pixels.assign((size_t)NATIVE_FRAME_WIDTH * NATIVE_FRAME_HEIGHT, 128);
+
+  qrQueue = halQueueCreate(NATIVE_QR_QUEUE_DEPTH, sizeof(QrScan));
+  decoder = qrDecoderCreate();
+  return qrQueue && decoder && frameRingStart(0) && halTaskCreate(decodeTask, "QR_Decode_Task", 64 * 1024, NULL, 5, 0);
+}
+
+void halCameraDecodeStats(QrDecodeStats *out)
+{
+  if (decoder)
+    qrDecoderStats(decoder, out);
+  else
+    memset(out, 0, sizeof(*out));
+}
+
+void halNativeInjectQr(const char *payload, bool valid)
+{
+  QrScan scan;
+  scan.valid = valid;
+  snprintf(scan.payload, sizeof(scan.payload), "%s", payload);
+  scan.frameUs = halMicros();
+  halQueueSend(qrQueue, &scan, 0);
+}
+
+bool halCameraReceiveQr(QrScan *out, uint32_t timeoutMs)
+{
+  return halQueueReceive(qrQueue, out, timeoutMs);
+}
+
+uint32_t halCameraMotionMs()
+{
+  QrDecodeStats stats;
+  halCameraDecodeStats(&stats);
+  return stats.motionMs;
+}
+
+// The scene files don't change with the sensor clock; only the capture
+// interval (frameRingSetInterval) slows the host down
+void halCameraStandby(bool standby)
+{
+  halLog("HAL: camera %s.\n", standby ? "in standby" : "at full rate");
+}
+
+// Likewise the recorded frames keep their size and exposure; `program tune`
+// simulates what these settings do to a frame
+void halCameraTune(const CameraTuning *tuning)
+{
+  (void)tuning;
+}
+
+int halNativeLoadFrame(const char *path)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return -1;
+
+  NativeFrame frame;
+  int width = 0, height = 0, maxVal = 0;
+  bool ok = fscanf(f, "P5 %d %d %d", &width, &height, &maxVal) == 3 && maxVal == 255 && fgetc(f) != EOF;
+  if (ok)
+  {
+    frame.width = (uint16_t)width;
+    frame.height = (uint16_t)height;
+    frame.pixels.resize((size_t)width * height);
+    ok = fread(frame.pixels.data(), 1, frame.pixels.size(), f) == frame.pixels.size();
+  }
+  fclose(f);
+  if (!ok)
+    return -1;
+
+  pthread_mutex_lock(&frameMutex);
+  frames.push_back(std::move(frame));
+  int index = (int)frames.size() - 1;
+  pthread_mutex_unlock(&frameMutex);
+  return index;
+}
+
+const uint8_t *halNativeFramePixels(int index, uint16_t *width, uint16_t *height)
+{
+  pthread_mutex_lock(&frameMutex);
+  const NativeFrame *frame = index >= 0 && index < (int)frames.size() ? &frames[index] : NULL;
+  pthread_mutex_unlock(&frameMutex);
+  if (!frame)
+    return NULL;
+  *width = frame->width;
+  *height = frame->height;
+  return frame->pixels.data();
+}
+
+void halNativeShowFrame(int index)
+{
+  pthread_mutex_lock(&frameMutex);
+  shownFrame = index >= 0 && index < (int)frames.size() ? index : -1;
+  pthread_mutex_unlock(&frameMutex);
+}
+
+bool halCameraFrameGet(HalFrame *frame)
+{
+  // Pace captures like the sensor would
+  uint64_t nextUs = lastCaptureUs + NATIVE_FRAME_INTERVAL_MS * 1000ULL;
+  uint64_t nowUs = halMicros();
+  if (nowUs < nextUs)
+    halDelayMs((uint32_t)((nextUs - nowUs) / 1000));
+  lastCaptureUs = halMicros();
+
+  pthread_mutex_lock(&frameMutex);
+  const NativeFrame &src = shownFrame >= 0 ? frames[shownFrame] : emptyScene;
+  pthread_mutex_unlock(&frameMutex);
+
+  frame->buf = src.pixels.data();
+  frame->len = src.pixels.size();
+  frame->width = src.width;
+  frame->height = src.height;
+  frame->timestampUs = lastCaptureUs;
+  frame->priv = NULL;
+  return true;
+}
+
+void halCameraFrameReturn(HalFrame *frame)
+{
+  frame->buf = NULL;
+}
+
+bool halCameraEncodeJpeg(const HalFrame *frame, int quality, uint8_t **jpeg, size_t *len)
+{
+  (void)frame;
+  (void)quality;
+  *jpeg = NULL;
+  *len = 0;
+  return false; // no encoder on the host; nothing streams here
+}
+
+// ---------------------- NETWORK ----------------------
+// The host is always online
+void halNetworkBegin()
+{
+}
+
+bool halNetworkWait(uint32_t timeoutMs)
+{
+  (void)timeoutMs;
+  return true;
+}
+
+// ---------------------- HTTP ----------------------
+// Minimal HTTP/1.1 client for http:// URLs, enough to talk to a local
+// stand-in for the access server. Like the device client each client keeps
+// one connection alive and reuses it while requests go to the same origin.
+struct HttpOrigin
+{
+  char host[128];
+  char port[8];
+  const char *path;
+};
+
+struct HalHttpClient
+{
+  int fd;
+  char connectedOrigin[sizeof(HttpOrigin::host) + sizeof(HttpOrigin::port)];
+};
+
+HalHttpClient *halHttpClientCreate()
+{
+  HalHttpClient *client = (HalHttpClient *)calloc(1, sizeof(HalHttpClient));
+  if (client)
+    client->fd = -1;
+  return client;
+}
+
+static bool parseUrl(const char *url, HttpOrigin *origin)
+{
+  if (strncmp(url, "http://", 7) != 0)
+  {
+    halLog("HTTP failed: unsupported scheme in %s\n", url);
+    return false;
+  }
+
+  const char *hostStart = url + 7;
+  const char *path = strchr(hostStart, '/');
+  size_t hostLen = path ? (size_t)(path - hostStart) : strlen(hostStart);
+  if (hostLen >= sizeof(origin->host))
+    return false;
+  memcpy(origin->host, hostStart, hostLen);
+  origin->host[hostLen] = '\0';
+  origin->path = path ? path : "/";
+  snprintf(origin->port, sizeof(origin->port), "80");
+
+  if (httpOverride[0] != '\0')
+    snprintf(origin->host, sizeof(origin->host), "%s", httpOverride);
+  char *colon = strchr(origin->host, ':');
+  if (colon)
+  {
+    *colon = '\0';
+    snprintf(origin->port, sizeof(origin->port), "%s", colon + 1);
+  }
+  return true;
+}
+
+static void httpDisconnect(HalHttpClient *client)
+{
+  if (client->fd >= 0)
+    close(client->fd);
+  client->fd = -1;
+  client->connectedOrigin[0] = '\0';
+}
+
+// Returns true when a live connection to origin is open, reusing the
+// current one if it points there
+static bool httpConnect(HalHttpClient *client, const HttpOrigin *origin, uint32_t timeoutMs, bool *reused)
+{
+  char key[sizeof(client->connectedOrigin)];
+  snprintf(key, sizeof(key), "%s:%s", origin->host, origin->port);
+
+  *reused = false;
+  if (client->fd >= 0 && strcmp(key, client->connectedOrigin) == 0)
+  {
+    // A readable idle socket means the server closed it (or sent garbage)
+    char probe;
+    ssize_t n = recv(client->fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      *reused = true;
+      return true;
+    }
+  }
+  httpDisconnect(client);
+
+  struct addrinfo hints = {};
+  struct addrinfo *res = NULL;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(origin->host, origin->port, &hints, &res) != 0 || !res)
+  {
+    halLog("HTTP failed: cannot resolve %s\n", origin->host);
+    return false;
+  }
+
+  int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  struct timeval tv = {(time_t)(timeoutMs / 1000), (suseconds_t)(timeoutMs % 1000) * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  bool connected = fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) == 0;
+  freeaddrinfo(res);
+  if (!connected)
+  {
+    halLog("HTTP failed: connection refused\n");
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+
+  client->fd = fd;
+  snprintf(client->connectedOrigin, sizeof(client->connectedOrigin), "%s", key);
+  return true;
+}
+
+// Sends one request on the open connection (a GET when contentType is NULL,
+// else a POST of data) and reads the response. Returns the status code, or 0
+// if the connection failed.
+static int httpExchange(HalHttpClient *client, const HttpOrigin *origin, const char *contentType,
+                        const uint8_t *data, size_t len, char *body, size_t bodyLen)
+{
+  char request[512];
+  int reqLen;
+  if (contentType)
+    reqLen = snprintf(request, sizeof(request),
+                      "POST %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\nContent-Type: %s\r\n"
+                      "Content-Length: %zu\r\n\r\n",
+                      origin->path, origin->host, contentType, len);
+  else
+    reqLen = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n",
+                      origin->path, origin->host);
+  if (reqLen >= (int)sizeof(request) || send(client->fd, request, reqLen, MSG_NOSIGNAL) != reqLen)
+    return 0;
+  if (len > 0 && send(client->fd, data, len, MSG_NOSIGNAL) != (ssize_t)len)
+    return 0;
+
+  char response[2048];
+  size_t total = 0;
+  char *headerEnd = NULL;
+  while (!headerEnd && total < sizeof(response) - 1)
+  {
+    ssize_t n = recv(client->fd, response + total, sizeof(response) - 1 - total, 0);
+    if (n <= 0)
+      return 0;
+    total += (size_t)n;
+    response[total] = '\0';
+    headerEnd = strstr(response, "\r\n\r\n");
+  }
+  if (!headerEnd)
+    return 0;
+
+  int httpCode = 0;
+  if (sscanf(response, "HTTP/%*d.%*d %d", &httpCode) != 1)
+    return 0;
+
+  // Bodies are small; read exactly Content-Length so the connection stays usable
+  size_t contentLength = 0;
+  const char *cl = strcasestr(response, "\r\nContent-Length:");
+  if (cl && cl < headerEnd)
+    contentLength = strtoul(cl + 17, NULL, 10);
+  bool serverCloses = strcasestr(response, "\r\nConnection: close") != NULL;
+
+  size_t headerLen = (size_t)(headerEnd + 4 - response);
+  while (total - headerLen < contentLength && total < sizeof(response) - 1)
+  {
+    ssize_t n = recv(client->fd, response + total, sizeof(response) - 1 - total, 0);
+    if (n <= 0)
+      return 0;
+    total += (size_t)n;
+  }
+  response[total] = '\0';
+
+  if (bodyLen > 0)
+    snprintf(body, bodyLen, "%s", response + headerLen);
+  if (serverCloses || total - headerLen != contentLength)
+    httpDisconnect(client);
+  return httpCode;
+}
+
+static int httpRequest(HalHttpClient *client, const char *url, const char *contentType, const uint8_t *data,
+                       size_t len, char *body, size_t bodyLen, uint32_t timeoutMs)
+{
+  if (bodyLen > 0)
+    body[0] = '\0';
+
+  HttpOrigin origin;
+  if (!parseUrl(url, &origin))
+    return 0;
+
+  // A kept-alive connection may have been dropped by the server since the
+  // last request; retry once on a fresh connection in that case
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    bool reused = false;
+    if (!httpConnect(client, &origin, timeoutMs, &reused))
+      return 0;
+
+    int httpCode = httpExchange(client, &origin, contentType, data, len, body, bodyLen);
+    if (httpCode > 0)
+      return httpCode;
+
+    httpDisconnect(client);
+    if (!reused)
+      break;
+  }
+  halLog("HTTP failed: connection lost\n");
+  return 0;
+}
+
+int halHttpGet(HalHttpClient *client, const char *url, char *body, size_t bodyLen, uint32_t timeoutMs)
+{
+  return httpRequest(client, url, NULL, NULL, 0, body, bodyLen, timeoutMs);
+}
+
+int halHttpPost(HalHttpClient *client, const char *url, const char *contentType, const uint8_t *data, size_t len,
+                char *body, size_t bodyLen, uint32_t timeoutMs)
+{
+  return httpRequest(client, url, contentType, data, len, body, bodyLen, timeoutMs);
+}
+
+bool halHttpWarmup(HalHttpClient *client, const char *url)
+{
+  HttpOrigin origin;
+  bool reused = false;
+  return parseUrl(url, &origin) && httpConnect(client, &origin, HTTP_TIMEOUT_MS, &reused);
+}
+
+void halNativeSetHttpOverride(const char *hostPort)
+{
+  snprintf(httpOverride, sizeof(httpOverride), "%s", hostPort ? hostPort : "");
+}
+
+// ---------------------- MEMORY / STORAGE ----------------------
+// Stored blobs are files named native_<key>.bin in NATIVE_STORAGE_DIR
+static void storagePath(const char *key, char *path, size_t len)
+{
+  const char *dir = getenv("NATIVE_STORAGE_DIR");
+  snprintf(path, len, "%s/native_%s.bin", dir ? dir : ".", key);
+}
+
+void *halAllocLarge(size_t size)
+{
+  return calloc(1, size);
+}
+
+bool halStorageLoad(const char *key, void *buf, size_t len)
+{
+  char path[256];
+  storagePath(key, path, sizeof(path));
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return false;
+  bool ok = fread(buf, 1, len, f) == len && fgetc(f) == EOF;
+  fclose(f);
+  return ok;
+}
+
+bool halStorageSave(const char *key, const void *buf, size_t len)
+{
+  char path[256];
+  char tmp[260];
+  storagePath(key, path, sizeof(path));
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  // Plain fds rather than stdio: saves run on pipeline tasks, and fopen
+  // allocates the FILE and its buffer
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+  bool ok = write(fd, buf, len) == (ssize_t)len;
+  ok = close(fd) == 0 && ok;
+  return ok && rename(tmp, path) == 0;
+}
+
+// The audit region is native_audit.bin next to the stored blobs, created
+// erased on first use and kept open
+static int auditRegionFd()
+{
+  static int fd = -1;
+  static pthread_mutex_t openMutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_mutex_lock(&openMutex);
+  if (fd < 0)
+  {
+    char path[256];
+    storagePath("audit", path, sizeof(path));
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size != NATIVE_AUDIT_REGION_BYTES)
+    {
+      uint8_t sector[HAL_AUDIT_SECTOR_BYTES];
+      memset(sector, 0xFF, sizeof(sector));
+      bool ok = ftruncate(fd, 0) == 0;
+      for (size_t off = 0; ok && off < NATIVE_AUDIT_REGION_BYTES; off += sizeof(sector))
+        ok = pwrite(fd, sector, sizeof(sector), (off_t)off) == (ssize_t)sizeof(sector);
+      if (!ok)
+      {
+        close(fd);
+        fd = -1;
+      }
+    }
+  }
+  pthread_mutex_unlock(&openMutex);
+  return fd;
+}
+
+size_t halAuditRegionSize()
+{
+  return auditRegionFd() >= 0 ? NATIVE_AUDIT_REGION_BYTES : 0;
+}
+
+bool halAuditRegionRead(size_t offset, void *buf, size_t len)
+{
+  int fd = auditRegionFd();
+  return fd >= 0 && offset + len <= NATIVE_AUDIT_REGION_BYTES && pread(fd, buf, len, (off_t)offset) == (ssize_t)len;
+}
+
+// Programs like NOR flash: the result is the AND of old and new bytes
+bool halAuditRegionWrite(size_t offset, const void *buf, size_t len)
+{
+  int fd = auditRegionFd();
+  if (fd < 0 || offset + len > NATIVE_AUDIT_REGION_BYTES)
+    return false;
+  uint8_t chunk[256];
+  const uint8_t *src = (const uint8_t *)buf;
+  for (size_t done = 0; done < len;)
+  {
+    size_t n = len - done < sizeof(chunk) ? len - done : sizeof(chunk);
+    if (pread(fd, chunk, n, (off_t)(offset + done)) != (ssize_t)n)
+      return false;
+    for (size_t i = 0; i < n; i++)
+      chunk[i] &= src[done + i];
+    if (pwrite(fd, chunk, n, (off_t)(offset + done)) != (ssize_t)n)
+      return false;
+    done += n;
+  }
+  return true;
+}
+
+bool halAuditRegionErase(size_t sector)
+{
+  int fd = auditRegionFd();
+  if (fd < 0 || (sector + 1) * HAL_AUDIT_SECTOR_BYTES > NATIVE_AUDIT_REGION_BYTES)
+    return false;
+  uint8_t erased[HAL_AUDIT_SECTOR_BYTES];
+  memset(erased, 0xFF, sizeof(erased));
+  return pwrite(fd, erased, sizeof(erased), (off_t)(sector * HAL_AUDIT_SECTOR_BYTES)) == (ssize_t)sizeof(erased);
+}
+
+// ---------------------- DIAGNOSTICS ----------------------
+// Runtimes are per-thread CPU time in microseconds against the wall clock.
+// Stack figures are for the host stacks (at least NATIVE_MIN_STACK).
+size_t halTaskStats(HalTaskStat *out, size_t max, uint32_t *totalRuntime)
+{
+  pthread_mutex_lock(&taskMutex);
+  size_t n = taskCount < max ? taskCount : max;
+  for (size_t i = 0; i < n; i++)
+  {
+    const NativeTask *task = &tasks[i];
+    HalTaskStat *stat = &out[i];
+    memcpy(stat->name, task->name, sizeof(stat->name));
+    stat->id = (uint32_t)i + 1;
+    stat->core = task->core;
+    stat->priority = task->priority;
+
+    clockid_t clock;
+    struct timespec ts;
+    stat->runtime = 0;
+    if (pthread_getcpuclockid(task->thread, &clock) == 0 && clock_gettime(clock, &ts) == 0)
+      stat->runtime = (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+
+    // The stack grows down from the top; untouched bytes are still painted
+    size_t untouched = 0;
+    while (untouched < task->stackBytes && task->stack[untouched] == NATIVE_STACK_FILL)
+      untouched++;
+    stat->stackBytes = (uint32_t)task->stackBytes;
+    stat->stackMinFree = (uint32_t)untouched;
+  }
+  pthread_mutex_unlock(&taskMutex);
+  *totalRuntime = (uint32_t)halMicros();
+  return n;
+}
+
+size_t halHeapStats(HalHeapStat *out, size_t max)
+{
+  if (max == 0)
+    return 0;
+  struct mallinfo2 info = mallinfo2();
+  out[0].name = "malloc";
+  out[0].totalBytes = info.arena + info.hblkhd;
+  out[0].freeBytes = info.fordblks;
+  out[0].largestFreeBlock = 0;
+  out[0].minFreeBytes = 0;
+  return 1;
+}
+
+// ---------------------- GPIO / POWER ----------------------
+void halToneInit()
+{
+  toneFrequency = 0;
+}
+
+void halToneWrite(uint32_t frequency)
+{
+  toneFrequency = frequency;
+}
+
+uint32_t halNativeToneFrequency()
+{
+  return toneFrequency;
+}
+
+void halLockInit()
+{
+  lockOpen = false;
+}
+
+void halLockWrite(bool open)
+{
+  lockOpen = open;
+}
+
+bool halNativeLockOpen()
+{
+  return lockOpen;
+}
+
+void halButtonInit()
+{
+}
+
+void halButtonOnPress(HalIsrFn onPress)
+{
+  buttonIsr = onPress;
+}
+
+// Runs the handler on the caller's thread, standing in for the interrupt
+void halNativePressButton()
+{
+  if (buttonIsr)
+    buttonIsr();
+}
+
+void halPowerSave(bool enable)
+{
+  halLog("HAL: power save %s.\n", enable ? "on" : "off");
+}
+
+void halRestart()
+{
+  halLog("HAL: restart requested, exiting.\n");
+  exit(0);
+}
+
+void halDeepSleep()
+{
+  halLog("HAL: deep sleep requested, exiting.\n");
+  exit(0);
+}
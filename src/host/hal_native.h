@@ -0,0 +1,40 @@
+#pragma once
+
+// Host-only hooks into the native HAL. The host entry points use these to
+// play recorded input into the pipeline and to observe its outputs.
+
+#include <stdint.h>
+#include "hal.h"
+#include "qr_decoder.h"
+
+// Queues a decode result as if the camera/decoder had produced it.
+void halNativeInjectQr(const char *payload, bool valid);
+
+// Loads a binary PGM (P5) grayscale frame. Returns its index, or -1.
+int halNativeLoadFrame(const char *path);
+
+// Pixels of a loaded frame, or NULL for an unknown index.
+const uint8_t *halNativeFramePixels(int index, uint16_t *width, uint16_t *height);
+
+// Puts a loaded frame in front of the camera; -1 shows an empty scene.
+// The camera backend decodes whatever is in view, like the reader task.
+void halNativeShowFrame(int index);
+
+// Sends every HTTP request to host:port instead of the URL's own host, so
+// recorded payloads can be validated against a local stand-in server.
+void halNativeSetHttpOverride(const char *hostPort);
+
+// Simulates a press of the restart button.
+void halNativePressButton();
+
+bool halNativeLockOpen();
+uint32_t halNativeToneFrequency();
+
+// Suppresses halLog output (benchmarks print their own report).
+void halNativeSetQuiet(bool quiet);
+
+// Heap allocation counting (alloc_count.cpp). While enabled, every
+// malloc-family call made on a halTaskCreate thread is counted.
+void halNativeCountAllocs(bool enable); // enabling resets the count
+uint64_t halNativeAllocCount();
+void halNativeMarkTaskThread(); // called on each task thread as it starts
@@ -0,0 +1,163 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "hal.h"
+#include "http_standin.h"
+
+static pthread_mutex_t standinMutex = PTHREAD_MUTEX_INITIALIZER;
+static int responseStatus = 200;
+static char responseBody[256] = "{\"grant\":true}";
+static volatile uint32_t responseDelayMs = 0;
+static volatile uint32_t connections = 0;
+static int listenFd = -1;
+
+void httpStandinSetResponse(int status, const char *body)
+{
+  pthread_mutex_lock(&standinMutex);
+  responseStatus = status;
+  snprintf(responseBody, sizeof(responseBody), "%s", body);
+  pthread_mutex_unlock(&standinMutex);
+}
+
+void httpStandinSetDelayMs(uint32_t delayMs)
+{
+  responseDelayMs = delayMs;
+}
+
+uint32_t httpStandinConnections()
+{
+  return connections;
+}
+
+static const char *reasonPhrase(int status)
+{
+  switch (status)
+  {
+  case 200:
+    return "OK";
+  case 401:
+    return "Unauthorized";
+  case 403:
+    return "Forbidden";
+  case 404:
+    return "Not Found";
+  default:
+    return "Status";
+  }
+}
+
+static void *connectionThread(void *arg)
+{
+  int fd = (int)(intptr_t)arg;
+  char request[2048];
+  size_t used = 0;
+
+  while (true)
+  {
+    ssize_t n = recv(fd, request + used, sizeof(request) - 1 - used, 0);
+    if (n <= 0)
+      break;
+    used += (size_t)n;
+    request[used] = '\0';
+
+    char *end = strstr(request, "\r\n\r\n");
+    if (!end)
+    {
+      if (used == sizeof(request) - 1)
+        break;
+      continue;
+    }
+
+    bool closeAfter = strcasestr(request, "Connection: close") != NULL;
+
+    // Request bodies (audit uploads) are read and dropped
+    size_t consumed = (size_t)(end + 4 - request);
+    size_t contentLength = 0;
+    const char *cl = strcasestr(request, "\r\nContent-Length:");
+    if (cl && cl < end)
+      contentLength = strtoul(cl + 17, NULL, 10);
+    size_t buffered = used - consumed < contentLength ? used - consumed : contentLength;
+    consumed += buffered;
+    size_t rest = contentLength - buffered;
+    while (rest > 0)
+    {
+      char scratch[512];
+      ssize_t got = recv(fd, scratch, rest < sizeof(scratch) ? rest : sizeof(scratch), 0);
+      if (got <= 0)
+        break;
+      rest -= (size_t)got;
+    }
+    if (rest > 0)
+      break;
+
+    if (responseDelayMs > 0)
+      halDelayMs(responseDelayMs);
+
+    char response[512];
+    pthread_mutex_lock(&standinMutex);
+    int len = snprintf(response, sizeof(response),
+                       "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %u\r\n%s\r\n%s",
+                       responseStatus, reasonPhrase(responseStatus), (unsigned)strlen(responseBody),
+                       closeAfter ? "Connection: close\r\n" : "", responseBody);
+    pthread_mutex_unlock(&standinMutex);
+    if (send(fd, response, (size_t)len, MSG_NOSIGNAL) != len || closeAfter)
+      break;
+
+    // Keep any pipelined bytes that followed this request
+    memmove(request, request + consumed, used - consumed);
+    used -= consumed;
+  }
+  close(fd);
+  return NULL;
+}
+
+static void *acceptThread(void *arg)
+{
+  (void)arg;
+  while (true)
+  {
+    int fd = accept(listenFd, NULL, NULL);
+    if (fd < 0)
+      continue;
+    __atomic_add_fetch(&connections, 1, __ATOMIC_RELAXED);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, connectionThread, (void *)(intptr_t)fd) == 0)
+      pthread_detach(thread);
+    else
+      close(fd);
+  }
+  return NULL;
+}
+
+int httpStandinStart()
+{
+  listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenFd < 0)
+    return -1;
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  socklen_t addrLen = sizeof(addr);
+  if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd, 16) != 0 ||
+      getsockname(listenFd, (struct sockaddr *)&addr, &addrLen) != 0)
+  {
+    close(listenFd);
+    listenFd = -1;
+    return -1;
+  }
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, acceptThread, NULL) != 0)
+    return -1;
+  pthread_detach(thread);
+  return ntohs(addr.sin_port);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// Local stand-in for the access server, used by the host tools. Listens on
+// 127.0.0.1 and answers every request with the configured status and body
+// after an optional delay (POST bodies are read and dropped). Connections
+// are kept alive unless the client asks to close them.
+
+#include <stdint.h>
+
+// Starts the server on an ephemeral port and returns it, or -1 on failure.
+int httpStandinStart();
+
+void httpStandinSetResponse(int status, const char *body);
+void httpStandinSetDelayMs(uint32_t delayMs);
+
+// Number of TCP connections accepted so far.
+uint32_t httpStandinConnections();
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "binarize.h"
+#include "hal.h"
+#include "hal_native.h"
+#include "tools.h"
+
+// Decoder front-end kernels on recorded frames. First checks that the
+// compiled-in kernels (binarizeKernelName()) match the scalar reference
+// bit for bit on every frame, then times both. Exits non-zero on a mismatch.
+
+struct KernelFrame
+{
+  const char *path;
+  const uint8_t *pixels;
+  uint16_t width;
+  uint16_t height;
+};
+
+static void thresholdsFor(const uint8_t *means, size_t count, uint8_t *thresholds)
+{
+  for (size_t i = 0; i < count; i++)
+    thresholds[i] = (uint8_t)(means[i] * BINARIZE_DARK_PCT / 100);
+}
+
+// Runs one pass of both kernels over a frame with either implementation
+static void runKernels(const KernelFrame &frame, bool reference, uint8_t *means, uint8_t *thresholds, uint8_t *bits)
+{
+  uint16_t tilesX = frame.width / BINARIZE_TILE_PX;
+  uint16_t tilesY = frame.height / BINARIZE_TILE_PX;
+  if (reference)
+    tileMeansScalar(frame.pixels, frame.width, frame.height, means);
+  else
+    tileMeans(frame.pixels, frame.width, frame.height, means);
+
+  thresholdsFor(means, (size_t)tilesX * tilesY, thresholds);
+  size_t rowLen = (size_t)tilesX * BINARIZE_TILE_PX;
+  for (uint16_t y = 0; y < tilesY * BINARIZE_TILE_PX; y++)
+  {
+    const uint8_t *row = frame.pixels + (size_t)y * frame.width;
+    const uint8_t *rowThresholds = thresholds + (size_t)(y / BINARIZE_TILE_PX) * tilesX;
+    if (reference)
+      binarizeRowScalar(row, frame.width, rowThresholds, bits + y * rowLen);
+    else
+      binarizeRow(row, frame.width, rowThresholds, bits + y * rowLen);
+  }
+}
+
+static double timePerFrameUs(const std::vector<KernelFrame> &frames, bool reference, int iterations,
+                             uint8_t *means, uint8_t *thresholds, uint8_t *bits)
+{
+  uint64_t startUs = halMicros();
+  for (int i = 0; i < iterations; i++)
+    for (const KernelFrame &frame : frames)
+      runKernels(frame, reference, means, thresholds, bits);
+  return (double)(halMicros() - startUs) / ((double)iterations * frames.size());
+}
+
+int kernelsMain(int argc, char **argv)
+{
+  int iterations = 100;
+  std::vector<KernelFrame> frames;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+      iterations = atoi(argv[++i]);
+    else if (argv[i][0] == '-')
+      return 2;
+    else
+    {
+      KernelFrame frame;
+      frame.path = argv[i];
+      int index = halNativeLoadFrame(argv[i]);
+      frame.pixels = index < 0 ? NULL : halNativeFramePixels(index, &frame.width, &frame.height);
+      if (!frame.pixels)
+      {
+        fprintf(stderr, "kernels: cannot load frame %s\n", argv[i]);
+        return 1;
+      }
+      frames.push_back(frame);
+    }
+  }
+  if (frames.empty() || iterations <= 0)
+    return 2;
+
+  // Sized for the largest frame; both implementations share the buffers
+  size_t maxPixels = 0;
+  for (const KernelFrame &frame : frames)
+    maxPixels = (size_t)frame.width * frame.height > maxPixels ? (size_t)frame.width * frame.height : maxPixels;
+  size_t maxTiles = maxPixels / (BINARIZE_TILE_PX * BINARIZE_TILE_PX);
+  std::vector<uint8_t> means(maxTiles), thresholds(maxTiles), bits(maxPixels);
+  std::vector<uint8_t> refMeans(maxTiles), refThresholds(maxTiles), refBits(maxPixels);
+
+  // ---------- Equivalence ----------
+  int mismatches = 0;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    const KernelFrame &frame = frames[i];
+    size_t tiles = (size_t)(frame.width / BINARIZE_TILE_PX) * (frame.height / BINARIZE_TILE_PX);
+    size_t pixels = tiles * BINARIZE_TILE_PX * BINARIZE_TILE_PX;
+    runKernels(frame, true, refMeans.data(), refThresholds.data(), refBits.data());
+    runKernels(frame, false, means.data(), thresholds.data(), bits.data());
+    bool same = memcmp(means.data(), refMeans.data(), tiles) == 0 && memcmp(bits.data(), refBits.data(), pixels) == 0;
+    if (!same)
+    {
+      fprintf(stderr, "kernels: %s output differs from scalar on %s\n", binarizeKernelName(), frame.path);
+      mismatches++;
+    }
+  }
+
+  // ---------- Timing ----------
+  double scalarUs = timePerFrameUs(frames, true, iterations, refMeans.data(), refThresholds.data(), refBits.data());
+  double vectorUs = timePerFrameUs(frames, false, iterations, means.data(), thresholds.data(), bits.data());
+
+  printf("decoder front-end kernels: %zu frames x %d iterations\n", frames.size(), iterations);
+  printf("%-8s %12s\n", "kernel", "us/frame");
+  printf("%-8s %12.2f\n", "scalar", scalarUs);
+  printf("%-8s %12.2f  (%.1fx)\n", binarizeKernelName(), vectorUs, vectorUs > 0 ? scalarUs / vectorUs : 0.0);
+  printf("bit-exact: %s\n", mismatches == 0 ? "yes" : "NO");
+  return mismatches == 0 ? 0 : 1;
+}
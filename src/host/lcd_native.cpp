@@ -0,0 +1,65 @@
+#include <pthread.h>
+#include <string.h>
+#include "hal.h"
+#include "lcd.h"
+
+// Host stand-in for the 16x2 HD44780: keeps the visible characters and
+// logs the display whenever it changes.
+
+#define LCD_COLS 16
+#define LCD_ROWS 2
+
+static char screen[LCD_ROWS][LCD_COLS + 1];
+static bool displayOn = false;
+static pthread_mutex_t lcdMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void blank()
+{
+  for (int row = 0; row < LCD_ROWS; row++)
+  {
+    memset(screen[row], ' ', LCD_COLS);
+    screen[row][LCD_COLS] = '\0';
+  }
+}
+
+static void show()
+{
+  halLog("LCD: |%s|%s|\n", screen[0], screen[1]);
+}
+
+static void put(const char *message, int line)
+{
+  if (line < 0 || line >= LCD_ROWS)
+    return;
+  size_t len = strlen(message);
+  memcpy(screen[line], message, len < LCD_COLS ? len : LCD_COLS);
+}
+
+void lcdInit()
+{
+  pthread_mutex_lock(&lcdMutex);
+  displayOn = true;
+  blank();
+  put("initializing...", 0);
+  show();
+  pthread_mutex_unlock(&lcdMutex);
+}
+
+void lcdWrite(int col, int line, const char *text, int len)
+{
+  if (line < 0 || line >= LCD_ROWS || col < 0 || col >= LCD_COLS)
+    return;
+  if (len > LCD_COLS - col)
+    len = LCD_COLS - col;
+  pthread_mutex_lock(&lcdMutex);
+  memcpy(screen[line] + col, text, len);
+  show();
+  pthread_mutex_unlock(&lcdMutex);
+}
+
+void lcdOff()
+{
+  pthread_mutex_lock(&lcdMutex);
+  displayOn = false;
+  pthread_mutex_unlock(&lcdMutex);
+}
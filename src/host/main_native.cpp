@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "app.h"
+#include "buzzer.h"
+#include "hal.h"
+#include "hal_native.h"
+#include "lcd.h"
+#include "profiler.h"
+#include "tools.h"
+
+// Host entry point. Subcommands:
+//   run [script] [tail_ms]   run the pipeline and play a scan script into it
+//   bench [options] [frames] scan-to-unlock latency benchmark (bench.cpp)
+//   kernels [options] frames decoder kernel equivalence check and timing (kernels.cpp)
+//   replay [options] manifest decode accuracy and throughput against a baseline (replay.cpp)
+//   tune [options] manifest   sensor tuner simulation over a replay corpus (tune.cpp)
+//   sched [options]           scheduler timer wheel check on a virtual clock (sched.cpp)
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s run [script] [tail_ms]\n", prog);
+  fprintf(stderr, "       %s bench [--runs N] [--server host:port] [--server-delay-ms D] [--check-allocs] [frame.pgm ...]\n", prog);
+  fprintf(stderr, "       %s kernels [--iterations N] frame.pgm ...\n", prog);
+  fprintf(stderr, "       %s replay [--iterations N] [--baseline FILE] [--fps-tolerance PCT] [--write-baseline] manifest\n", prog);
+  fprintf(stderr, "       %s tune [--hold N] [--passes N] [--backlight PCT] manifest\n", prog);
+  fprintf(stderr, "       %s sched [--timers N] [--seconds N] [--ops N] [--seed S]\n", prog);
+}
+
+// Script lines are
+//   <delay_ms> <payload>   decoded QR with the given payload
+//   <delay_ms> !invalid    QR seen but not decodable
+//   <delay_ms> !frame <n>  put loaded frame n in view (-1 clears the view)
+//   <delay_ms> !load <pgm> load a recorded grayscale frame
+//   <delay_ms> !button     restart button press
+//   <delay_ms> !profile    log a task/stack/heap profile now
+// Lines starting with '#' are ignored. The process exits tailMs after the
+// last script line.
+int runMain(int argc, char **argv)
+{
+  if (argc > 2)
+    return 2;
+
+  FILE *script = stdin;
+  if (argc > 0 && strcmp(argv[0], "-") != 0)
+  {
+    script = fopen(argv[0], "r");
+    if (!script)
+    {
+      perror(argv[0]);
+      return 1;
+    }
+  }
+  uint32_t tailMs = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 10000;
+
+  lcdInit();
+  buzzerInit();
+  halButtonInit();
+  halLockInit();
+  if (!halCameraInit() || !appStart())
+    return 1;
+  appReady();
+
+  char line[QR_PAYLOAD_LEN + 32];
+  while (fgets(line, sizeof(line), script))
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '#' || line[0] == '\0')
+      continue;
+
+    char *payload = NULL;
+    unsigned long delayMs = strtoul(line, &payload, 10);
+    while (*payload == ' ')
+      payload++;
+    halDelayMs(delayMs);
+
+    if (strcmp(payload, "!invalid") == 0)
+      halNativeInjectQr("", false);
+    else if (strcmp(payload, "!button") == 0)
+      halNativePressButton();
+    else if (strcmp(payload, "!profile") == 0)
+      profilerSample();
+    else if (strncmp(payload, "!frame ", 7) == 0)
+      halNativeShowFrame(atoi(payload + 7));
+    else if (strncmp(payload, "!load ", 6) == 0)
+    {
+      if (halNativeLoadFrame(payload + 6) < 0)
+        halLog("run: cannot load frame %s\n", payload + 6);
+    }
+    else
+      halNativeInjectQr(payload, true);
+  }
+  if (script != stdin)
+    fclose(script);
+
+  halDelayMs(tailMs);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  int rc = 2;
+  if (strcmp(argv[1], "run") == 0)
+    rc = runMain(argc - 2, argv + 2);
+  else if (strcmp(argv[1], "bench") == 0)
+    rc = benchMain(argc - 2, argv + 2);
+  else if (strcmp(argv[1], "kernels") == 0)
+    rc = kernelsMain(argc - 2, argv + 2);
+  else if (strcmp(argv[1], "replay") == 0)
+    rc = replayMain(argc - 2, argv + 2);
+  else if (strcmp(argv[1], "tune") == 0)
+    rc = tuneMain(argc - 2, argv + 2);
+  else if (strcmp(argv[1], "sched") == 0)
+    rc = schedMain(argc - 2, argv + 2);
+
+  if (rc == 2)
+    usage(argv[0]);
+  return rc;
+}
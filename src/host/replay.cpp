@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "hal.h"
+#include "hal_native.h"
+#include "qr_decoder.h"
+#include "tools.h"
+
+// Decode accuracy and throughput over a corpus of recorded frames. Every
+// frame goes through qrDecodeFrame, the same gate + quirc path the camera
+// backends use, once for accuracy and then --iterations times for speed.
+// The results are compared with a baseline file, and a regression in
+// accuracy or throughput fails the run.
+//
+// The manifest lists one frame per line, relative to the manifest's
+// directory, followed by the payloads it holds:
+//   <frame.pgm> <payload> [<payload> ...]   any one of these is a correct decode
+//   <frame.pgm> -                           no readable code in view
+// Lines starting with '#' are ignored.
+
+#define REPLAY_FPS_TOLERANCE_PCT 20 // default allowance for a slower machine or a noisy run
+
+enum ReplayOutcome
+{
+  REPLAY_DECODED, // one of the expected payloads
+  REPLAY_MISSED,  // a code was expected, none decoded
+  REPLAY_WRONG,   // decoded a payload that isn't in view: a false positive
+  REPLAY_NONE     // nothing expected, nothing decoded
+};
+
+static const char *const outcomeNames[] = {"decoded", "missed", "wrong", "none"};
+
+struct ReplayFrame
+{
+  std::string name; // as written in the manifest
+  std::vector<std::string> payloads;
+  const uint8_t *pixels;
+  uint16_t width;
+  uint16_t height;
+  ReplayOutcome outcome;
+  std::string decoded;
+  double decodeUs;
+};
+
+struct ReplayBaseline
+{
+  double decodeRate = -1; // -1 = not recorded
+  double falsePositiveRate = -1;
+  double framesPerSec = -1;
+  std::vector<std::pair<std::string, std::string>> frames; // name, outcome
+};
+
+static std::string directoryOf(const char *path)
+{
+  const char *slash = strrchr(path, '/');
+  return slash ? std::string(path, slash - path + 1) : std::string();
+}
+
+static bool loadManifest(const char *path, std::vector<ReplayFrame> *frames)
+{
+  FILE *f = fopen(path, "r");
+  if (!f)
+  {
+    perror(path);
+    return false;
+  }
+
+  std::string dir = directoryOf(path);
+  char line[1024];
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f))
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    char *token = strtok(line, " \t");
+    if (!token || token[0] == '#')
+      continue;
+
+    ReplayFrame frame;
+    frame.name = token;
+    while ((token = strtok(NULL, " \t")) != NULL)
+    {
+      if (strcmp(token, "-") != 0)
+        frame.payloads.push_back(token);
+    }
+
+    std::string framePath = dir + frame.name;
+    int index = halNativeLoadFrame(framePath.c_str());
+    frame.pixels = index < 0 ? NULL : halNativeFramePixels(index, &frame.width, &frame.height);
+    if (!frame.pixels)
+    {
+      fprintf(stderr, "replay: cannot load frame %s\n", framePath.c_str());
+      ok = false;
+    }
+    frames->push_back(frame);
+  }
+  fclose(f);
+  return ok;
+}
+
+// Missing file or keys leave the matching checks off
+static bool loadBaseline(const char *path, ReplayBaseline *baseline)
+{
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return false;
+
+  char line[512];
+  while (fgets(line, sizeof(line), f))
+  {
+    char key[32], name[256], outcome[16];
+    double value;
+    if (line[0] == '#' || sscanf(line, "%31s", key) != 1)
+      continue;
+    if (strcmp(key, "frame") == 0)
+    {
+      if (sscanf(line, "%*s %255s %15s", name, outcome) == 2)
+        baseline->frames.push_back(std::make_pair(std::string(name), std::string(outcome)));
+    }
+    else if (sscanf(line, "%*s %lf", &value) == 1)
+    {
+      if (strcmp(key, "decode_rate") == 0)
+        baseline->decodeRate = value;
+      else if (strcmp(key, "false_positive_rate") == 0)
+        baseline->falsePositiveRate = value;
+      else if (strcmp(key, "frames_per_sec") == 0)
+        baseline->framesPerSec = value;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+static bool writeBaseline(const char *path, const char *manifest, const std::vector<ReplayFrame> &frames,
+                          double decodeRate, double falsePositiveRate, double framesPerSec)
+{
+  FILE *f = fopen(path, "w");
+  if (!f)
+  {
+    perror(path);
+    return false;
+  }
+  fprintf(f, "# Replay baseline for %s, written by `program replay --write-baseline`.\n", manifest);
+  fprintf(f, "# A run fails if a frame decoded here is missed, a rate gets worse, or\n");
+  fprintf(f, "# frames_per_sec drops by more than the tolerance.\n");
+  fprintf(f, "decode_rate %.4f\n", decodeRate);
+  fprintf(f, "false_positive_rate %.4f\n", falsePositiveRate);
+  fprintf(f, "frames_per_sec %.1f\n", framesPerSec);
+  for (const ReplayFrame &frame : frames)
+    fprintf(f, "frame %s %s\n", frame.name.c_str(), outcomeNames[frame.outcome]);
+  fclose(f);
+  return true;
+}
+
+// Frames are stamped REPLAY_SPACING_US apart so that the motion gate and the
+// ROI crop never carry anything over: every call is a full-frame decode
+#define REPLAY_SPACING_US (2ULL * QR_GATE_REFRESH_MS * 1000ULL)
+
+static ReplayOutcome decodeOne(QrDecoder *decoder, const ReplayFrame &frame, uint64_t timestampUs, QrScan *scan)
+{
+  HalFrame hal = {frame.pixels, (size_t)frame.width * frame.height, frame.width, frame.height, timestampUs, NULL};
+  bool found = qrDecodeFrame(decoder, &hal, scan);
+  bool decoded = found && scan->valid;
+  if (!decoded)
+    return frame.payloads.empty() ? REPLAY_NONE : REPLAY_MISSED;
+  for (const std::string &payload : frame.payloads)
+  {
+    if (payload == scan->payload)
+      return REPLAY_DECODED;
+  }
+  return REPLAY_WRONG;
+}
+
+int replayMain(int argc, char **argv)
+{
+  int iterations = 20;
+  int fpsTolerancePct = REPLAY_FPS_TOLERANCE_PCT;
+  bool write = false;
+  const char *manifest = NULL;
+  std::string baselinePath;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+      iterations = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+      baselinePath = argv[++i];
+    else if (strcmp(argv[i], "--fps-tolerance") == 0 && i + 1 < argc)
+      fpsTolerancePct = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--write-baseline") == 0)
+      write = true;
+    else if (argv[i][0] == '-' || manifest)
+      return 2;
+    else
+      manifest = argv[i];
+  }
+  if (!manifest || iterations <= 0)
+    return 2;
+  if (baselinePath.empty())
+    baselinePath = directoryOf(manifest) + "baseline.txt";
+
+  std::vector<ReplayFrame> frames;
+  if (!loadManifest(manifest, &frames))
+    return 1;
+  if (frames.empty())
+  {
+    fprintf(stderr, "replay: no frames in %s\n", manifest);
+    return 1;
+  }
+
+  QrDecoder *decoder = qrDecoderCreate();
+  if (!decoder)
+    return 1;
+  uint64_t timestampUs = REPLAY_SPACING_US;
+  QrScan scan;
+
+  // ---------- Accuracy ----------
+  int coded = 0, decoded = 0, wrong = 0;
+  for (ReplayFrame &frame : frames)
+  {
+    uint64_t startUs = halMicros();
+    frame.outcome = decodeOne(decoder, frame, timestampUs, &scan);
+    frame.decodeUs = (double)(halMicros() - startUs);
+    frame.decoded = frame.outcome == REPLAY_DECODED || frame.outcome == REPLAY_WRONG ? scan.payload : "";
+    timestampUs += REPLAY_SPACING_US;
+
+    coded += frame.payloads.empty() ? 0 : 1;
+    decoded += frame.outcome == REPLAY_DECODED ? 1 : 0;
+    wrong += frame.outcome == REPLAY_WRONG ? 1 : 0;
+  }
+
+  // ---------- Throughput ----------
+  uint64_t startUs = halMicros();
+  for (int i = 0; i < iterations; i++)
+  {
+    for (const ReplayFrame &frame : frames)
+    {
+      decodeOne(decoder, frame, timestampUs, &scan);
+      timestampUs += REPLAY_SPACING_US;
+    }
+  }
+  double elapsedS = (double)(halMicros() - startUs) / 1e6;
+  double framesPerSec = elapsedS > 0 ? (double)iterations * frames.size() / elapsedS : 0;
+
+  QrDecodeStats stats;
+  qrDecoderStats(decoder, &stats);
+  qrDecoderDestroy(decoder);
+
+  double decodeRate = coded > 0 ? (double)decoded / coded : 1.0;
+  double falsePositiveRate = (double)wrong / frames.size();
+
+  printf("%-28s %-8s %10s  %s\n", "frame", "outcome", "ms", "payload");
+  for (const ReplayFrame &frame : frames)
+    printf("%-28s %-8s %10.2f  %s\n", frame.name.c_str(), outcomeNames[frame.outcome], frame.decodeUs / 1000.0,
+           frame.decoded.c_str());
+  printf("frames: %zu (%d with a code), %d x %d iterations timed\n", frames.size(), coded, (int)frames.size(), iterations);
+  printf("decode rate:         %.4f (%d/%d)\n", decodeRate, decoded, coded);
+  printf("false positive rate: %.4f (%d/%zu)\n", falsePositiveRate, wrong, frames.size());
+  printf("frames/sec:          %.1f\n", framesPerSec);
+  printf("pre-scan rejects:    %u of %u decodes\n", stats.noFinder, stats.frames);
+
+  if (write)
+  {
+    if (!writeBaseline(baselinePath.c_str(), manifest, frames, decodeRate, falsePositiveRate, framesPerSec))
+      return 1;
+    printf("baseline written to %s\n", baselinePath.c_str());
+    return 0;
+  }
+
+  // ---------- Baseline ----------
+  ReplayBaseline baseline;
+  if (!loadBaseline(baselinePath.c_str(), &baseline))
+  {
+    fprintf(stderr, "replay: no baseline at %s (record one with --write-baseline)\n", baselinePath.c_str());
+    return 1;
+  }
+
+  int regressions = 0;
+  for (const ReplayFrame &frame : frames)
+  {
+    for (const auto &entry : baseline.frames)
+    {
+      if (entry.first != frame.name || entry.second == outcomeNames[frame.outcome])
+        continue;
+      bool worse = entry.second == outcomeNames[REPLAY_DECODED] || frame.outcome == REPLAY_WRONG;
+      printf("%s: %s %s, was %s\n", worse ? "REGRESSION" : "improved", frame.name.c_str(),
+             outcomeNames[frame.outcome], entry.second.c_str());
+      regressions += worse ? 1 : 0;
+    }
+  }
+  if (baseline.decodeRate >= 0 && decodeRate < baseline.decodeRate - 1e-4)
+  {
+    printf("REGRESSION: decode rate %.4f, baseline %.4f\n", decodeRate, baseline.decodeRate);
+    regressions++;
+  }
+  if (baseline.falsePositiveRate >= 0 && falsePositiveRate > baseline.falsePositiveRate + 1e-4)
+  {
+    printf("REGRESSION: false positive rate %.4f, baseline %.4f\n", falsePositiveRate, baseline.falsePositiveRate);
+    regressions++;
+  }
+  if (baseline.framesPerSec > 0)
+  {
+    double floor = baseline.framesPerSec * (100 - fpsTolerancePct) / 100.0;
+    if (framesPerSec < floor)
+    {
+      printf("REGRESSION: %.1f frames/sec, baseline %.1f (-%d%% allowed)\n", framesPerSec, baseline.framesPerSec,
+             fpsTolerancePct);
+      regressions++;
+    }
+  }
+  else
+    printf("no frames_per_sec in the baseline, throughput not checked\n");
+
+  printf("baseline %s: %s\n", baselinePath.c_str(), regressions == 0 ? "pass" : "FAIL");
+  return regressions == 0 ? 0 : 1;
+}
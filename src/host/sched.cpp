@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "hal.h"
+#include "scheduler.h"
+#include "tools.h"
+
+// Drives the scheduler's timer wheel from a virtual clock, without its task.
+// Each step runs schedRun() and then jumps the clock by the sleep it asked
+// for, or to the next scripted operation if that comes first, exactly as
+// the task would sleep. Random timers are armed, moved and cancelled from
+// outside and from their own handlers, with deadlines inside one wheel
+// revolution and far beyond it. Every timer must fire at its deadline to
+// the millisecond, once, and never after a cancel; a raised signal must run
+// on the next step. The run is repeated across the wrap of the 32-bit
+// millisecond clock. The wakeups are compared with the polling tasks the
+// scheduler replaced.
+
+#define SCHED_SIM_POLL_WAKEUPS_PER_S 31 // lock task every 100 ms, button every 50 ms, power every second
+
+struct SimTimer
+{
+  SchedTimer timer;
+  uint32_t dueMs;
+  bool armed;
+  bool periodic; // re-arms itself from its handler
+  uint32_t fired;
+};
+
+enum SimOpKind
+{
+  SIM_ARM,
+  SIM_CANCEL,
+  SIM_RAISE
+};
+
+struct SimOp
+{
+  uint32_t atMs;
+  SimOpKind kind;
+  int timer;
+  uint32_t delayMs;
+};
+
+static uint32_t virtualMs;
+static uint32_t lcg;
+static uint32_t spanMs; // longest delay drawn
+static uint32_t late, missed, spurious, signalsRun;
+
+static uint32_t randomNext()
+{
+  lcg = lcg * 1664525u + 1013904223u;
+  return lcg >> 8;
+}
+
+// Half the delays fall within a few wheel revolutions, half anywhere
+static uint32_t randomDelay()
+{
+  return 1 + randomNext() % ((randomNext() & 1) ? 2000 : spanMs);
+}
+
+static void onTimer(void *arg)
+{
+  SimTimer *sim = (SimTimer *)arg;
+  if (!sim->armed)
+  {
+    spurious++;
+    return;
+  }
+  if (virtualMs != sim->dueMs)
+    late++;
+  sim->armed = false;
+  sim->fired++;
+  if (sim->periodic)
+  {
+    sim->dueMs = virtualMs + randomDelay();
+    sim->armed = true;
+    schedAt(&sim->timer, sim->dueMs);
+  }
+}
+
+static void onSignal(void *arg)
+{
+  (void)arg;
+  signalsRun++;
+}
+
+struct SimResult
+{
+  uint32_t fired, wakeups, idleWakeups, raised, moved, cancelled;
+};
+
+// One run of seconds virtual seconds from startMs. Every timer is cancelled
+// at the end, so the wheel is empty for the next run.
+static bool simulate(uint32_t startMs, int timerCount, int seconds, int opCount, int signal, SimResult *res)
+{
+  uint32_t endMs = startMs + (uint32_t)seconds * 1000;
+  spanMs = (uint32_t)seconds * 1000 / 2;
+  virtualMs = startMs;
+  late = missed = spurious = signalsRun = 0;
+
+  std::vector<SimTimer> timers(timerCount);
+  for (int i = 0; i < timerCount; i++)
+  {
+    SimTimer *sim = &timers[i];
+    schedTimerInit(&sim->timer, onTimer, sim);
+    sim->periodic = i % 5 == 0;
+    sim->fired = 0;
+    sim->dueMs = startMs + randomDelay();
+    sim->armed = true;
+    schedAt(&sim->timer, sim->dueMs);
+  }
+
+  // Ordered by time since the start, which keeps its order across the wrap
+  std::vector<SimOp> ops(opCount);
+  for (SimOp &op : ops)
+  {
+    op.atMs = startMs + randomNext() % (endMs - startMs);
+    uint32_t kind = randomNext() % 8;
+    op.kind = kind == 0 ? SIM_RAISE : kind < 3 ? SIM_CANCEL : SIM_ARM;
+    op.timer = (int)(randomNext() % timerCount);
+    op.delayMs = randomDelay();
+  }
+  std::stable_sort(ops.begin(), ops.end(),
+                   [startMs](const SimOp &a, const SimOp &b) { return a.atMs - startMs < b.atMs - startMs; });
+
+  *res = {};
+  bool signalPending = false; // raised since the last step, coalesced
+  bool slept = false;          // this step ends a sleep, not an operation
+  size_t next = 0;
+  while ((int32_t)(virtualMs - endMs) < 0)
+  {
+    uint32_t firedBefore = 0, signalsBefore = signalsRun;
+    for (const SimTimer &sim : timers)
+      firedBefore += sim.fired;
+
+    uint32_t waitMs = schedRun(virtualMs);
+    res->wakeups++;
+
+    uint32_t firedAfter = 0;
+    for (SimTimer &sim : timers)
+    {
+      firedAfter += sim.fired;
+      if (sim.armed && (int32_t)(sim.dueMs - virtualMs) <= 0)
+      {
+        missed++;
+        sim.armed = false;
+        schedCancel(&sim.timer);
+      }
+    }
+    if (slept && firedAfter == firedBefore)
+      res->idleWakeups++;
+    if (signalPending && signalsRun == signalsBefore)
+      missed++;
+    signalPending = false;
+
+    uint32_t opMs = next < ops.size() ? ops[next].atMs : endMs;
+    slept = waitMs != HAL_WAIT_FOREVER && (int32_t)(virtualMs + waitMs - opMs) < 0;
+    if (slept)
+    {
+      virtualMs += waitMs;
+      continue;
+    }
+
+    // Operations from outside the scheduler, as other tasks would make them
+    virtualMs = opMs;
+    for (; next < ops.size() && ops[next].atMs == opMs; next++)
+    {
+      const SimOp &op = ops[next];
+      SimTimer *sim = &timers[op.timer];
+      if (op.kind == SIM_RAISE)
+      {
+        schedRaise(signal);
+        signalPending = true;
+        res->raised++;
+      }
+      else if (op.kind == SIM_CANCEL)
+      {
+        schedCancel(&sim->timer);
+        sim->armed = false;
+        res->cancelled++;
+      }
+      else
+      {
+        sim->dueMs = opMs + op.delayMs;
+        sim->armed = true;
+        schedAt(&sim->timer, sim->dueMs);
+        res->moved++;
+      }
+    }
+  }
+
+  for (SimTimer &sim : timers)
+  {
+    res->fired += sim.fired;
+    schedCancel(&sim.timer);
+  }
+  return !late && !missed && !spurious;
+}
+
+int schedMain(int argc, char **argv)
+{
+  int timerCount = 200;
+  int seconds = 600;
+  int opCount = 2000;
+  lcg = 1;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--timers") == 0 && i + 1 < argc)
+      timerCount = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+      seconds = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc)
+      opCount = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+      lcg = (uint32_t)strtoul(argv[++i], NULL, 10);
+    else
+      return 2;
+  }
+  if (timerCount <= 0 || seconds <= 0 || opCount < 0)
+    return 2;
+
+  if (!schedulerInit())
+    return 1;
+  int signal = schedSignalCreate(onSignal, NULL);
+  if (signal < 0)
+    return 1;
+
+  // Once from now, once across the wrap of halMillis() at 49.7 days, which
+  // falls halfway through the run
+  const uint32_t starts[] = {halMillis(), 0u - (uint32_t)seconds * 500};
+  const char *labels[] = {"from now", "across the millisecond wrap"};
+  bool ok = true;
+  for (int run = 0; run < 2; run++)
+  {
+    SimResult res;
+    ok &= simulate(starts[run], timerCount, seconds, opCount, signal, &res);
+    printf("sched %s: %d timers over %d virtual seconds, %u armed or moved, %u cancelled, %u signals\n", labels[run],
+           timerCount, seconds, res.moved, res.cancelled, res.raised);
+    printf("  %u fired: %u late, %u missed, %u after a cancel\n", res.fired, late, missed, spurious);
+    printf("  %u wakeups, %u of them timed with nothing due (polling tasks: %u)\n", res.wakeups, res.idleWakeups,
+           (uint32_t)seconds * SCHED_SIM_POLL_WAKEUPS_PER_S);
+  }
+  return ok ? 0 : 1;
+}
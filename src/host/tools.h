@@ -0,0 +1,11 @@
+#pragma once
+
+// Host tool entry points dispatched from main_native.cpp. Each takes the
+// arguments after its subcommand name and returns the process exit code.
+
+int runMain(int argc, char **argv);
+int benchMain(int argc, char **argv);
+int kernelsMain(int argc, char **argv);
+int replayMain(int argc, char **argv);
+int tuneMain(int argc, char **argv);
+int schedMain(int argc, char **argv);
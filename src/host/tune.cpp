@@ -0,0 +1,232 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "hal.h"
+#include "hal_native.h"
+#include "qr_decoder.h"
+#include "tools.h"
+#include "tuner.h"
+
+// Closed-loop simulation of the sensor tuner over a replay corpus (see
+// replay.cpp for the manifest format). Each frame is held in front of a
+// simulated sensor for --hold frames, and each pass goes through the whole
+// corpus. The sensor applies the tuner's settings to the recorded frame:
+//   - QVGA halves the frame each way; VGA is the frame as recorded, at half
+//     the frame rate
+//   - the exposure target scales the luma by 2^(level/2) and each gain step
+//     above the start adds a quarter, with noise that grows with the gain
+//   - --backlight PCT darkens the middle of the frame, where the code is,
+//     the way a bright window behind the visitor does
+// A small flicker from frame to frame stands in for a hand holding the code,
+// so the motion gate keeps decoding. The run is repeated with the settings
+// fixed at the tuner's start and both decode rates are printed.
+
+#define TUNE_SIM_FRAME_MS 40                // QVGA frame interval; VGA takes twice as long
+#define TUNE_SIM_FLICKER (QR_GATE_DIFF + 2) // luma added to every other frame, enough to count as motion
+
+struct TuneFrame
+{
+  std::string name;
+  std::vector<std::string> payloads;
+  const uint8_t *pixels;
+  uint16_t width;
+  uint16_t height;
+};
+
+struct TuneResult
+{
+  uint32_t simulated;   // frames the sensor delivered
+  uint32_t frames;      // of those, frames with a code in view
+  uint32_t decoded;     // of those, decoded to an expected payload
+  uint32_t virtualMs;   // simulated time the run took
+  uint32_t changes;     // settings changes
+  std::vector<int> hit; // per corpus frame: decoded at least once
+};
+
+static bool loadFrames(const char *manifest, std::vector<TuneFrame> *frames)
+{
+  FILE *f = fopen(manifest, "r");
+  if (!f)
+  {
+    perror(manifest);
+    return false;
+  }
+  const char *slash = strrchr(manifest, '/');
+  std::string dir = slash ? std::string(manifest, slash - manifest + 1) : std::string();
+
+  char line[1024];
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f))
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    char *token = strtok(line, " \t");
+    if (!token || token[0] == '#')
+      continue;
+
+    TuneFrame frame;
+    frame.name = token;
+    while ((token = strtok(NULL, " \t")) != NULL)
+    {
+      if (strcmp(token, "-") != 0)
+        frame.payloads.push_back(token);
+    }
+    int index = halNativeLoadFrame((dir + frame.name).c_str());
+    frame.pixels = index < 0 ? NULL : halNativeFramePixels(index, &frame.width, &frame.height);
+    if (!frame.pixels)
+    {
+      fprintf(stderr, "tune: cannot load frame %s%s\n", dir.c_str(), frame.name.c_str());
+      ok = false;
+    }
+    frames->push_back(frame);
+  }
+  fclose(f);
+  return ok;
+}
+
+// Renders what the sensor would deliver for frame with the given settings
+static void sense(const TuneFrame &frame, const CameraTuning *tuning, int backlightPct, uint32_t seq,
+                  std::vector<uint8_t> *out, uint16_t *width, uint16_t *height)
+{
+  int scale = tuning->highRes ? 1 : 2;
+  *width = frame.width / scale;
+  *height = frame.height / scale;
+  out->resize((size_t)*width * *height);
+
+  double gain = pow(2.0, tuning->aeLevel / 2.0) * (1.0 + 0.25 * (tuning->gainCeiling > 1 ? tuning->gainCeiling - 1 : 0));
+  int noise = 2 * tuning->gainCeiling;
+  int flicker = (seq & 1) ? TUNE_SIM_FLICKER : 0;
+  uint32_t lcg = seq * 2654435761u;
+  for (uint16_t y = 0; y < *height; y++)
+  {
+    for (uint16_t x = 0; x < *width; x++)
+    {
+      int sum = 0;
+      for (int dy = 0; dy < scale; dy++)
+      {
+        for (int dx = 0; dx < scale; dx++)
+          sum += frame.pixels[(size_t)(y * scale + dy) * frame.width + x * scale + dx];
+      }
+      double luma = (double)sum / (scale * scale);
+      bool middle = x >= *width / 4 && x < *width - *width / 4 && y >= *height / 4 && y < *height - *height / 4;
+      if (middle)
+        luma = luma * backlightPct / 100.0;
+      lcg = lcg * 1664525u + 1013904223u;
+      int value = (int)(luma * gain) + flicker + (noise ? (int)(lcg >> 24) % (2 * noise + 1) - noise : 0);
+      (*out)[(size_t)y * *width + x] = (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+    }
+  }
+}
+
+static void runSimulation(const std::vector<TuneFrame> &frames, bool tune, int hold, int passes, int backlightPct,
+                          TuneResult *result)
+{
+  QrDecoder *decoder = qrDecoderCreate();
+  if (!decoder)
+    return;
+  CameraTuning tuning;
+  tunerInit(&tuning);
+  *result = TuneResult();
+  result->hit.assign(frames.size(), 0);
+
+  std::vector<uint8_t> pixels;
+  uint32_t nowMs = 0, seq = 0;
+  QrScan scan;
+  for (int pass = 0; pass < passes; pass++)
+  {
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+      for (int held = 0; held < hold; held++, seq++)
+      {
+        uint16_t width, height;
+        sense(frames[i], &tuning, backlightPct, seq, &pixels, &width, &height);
+        HalFrame hal = {pixels.data(), pixels.size(), width, height, (uint64_t)nowMs * 1000ULL, NULL};
+        bool decoded = qrDecodeFrame(decoder, &hal, &scan) && scan.valid;
+        nowMs += TUNE_SIM_FRAME_MS * (tuning.highRes ? 2 : 1);
+
+        if (!frames[i].payloads.empty())
+        {
+          result->frames++;
+          for (const std::string &payload : frames[i].payloads)
+          {
+            if (decoded && payload == scan.payload)
+            {
+              result->decoded++;
+              result->hit[i] = 1;
+              break;
+            }
+          }
+        }
+
+        QrDecodeStats stats;
+        qrDecoderStats(decoder, &stats);
+        if (tune && tunerUpdate(&stats, nowMs, &tuning))
+        {
+          result->changes++;
+          printf("  %7.1fs  %-28s -> %s, exposure %+d, gain ceiling %dx\n", nowMs / 1000.0, frames[i].name.c_str(),
+                 tuning.highRes ? "VGA" : "QVGA", tuning.aeLevel, 2 << tuning.gainCeiling);
+        }
+      }
+    }
+  }
+  result->simulated = seq;
+  result->virtualMs = nowMs;
+  qrDecoderDestroy(decoder);
+}
+
+static void printResult(const char *label, const TuneResult &result, const std::vector<TuneFrame> &frames)
+{
+  int coded = 0, hits = 0;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    coded += frames[i].payloads.empty() ? 0 : 1;
+    hits += result.hit[i];
+  }
+  printf("%-6s decode rate %.4f (%u/%u frames with a code), %d/%d codes read, %.1f simulated fps, %u changes\n", label,
+         result.frames ? (double)result.decoded / result.frames : 0.0, result.decoded, result.frames, hits, coded,
+         result.virtualMs ? 1000.0 * result.simulated / result.virtualMs : 0.0, result.changes);
+}
+
+int tuneMain(int argc, char **argv)
+{
+  int hold = 50;
+  int passes = 3;
+  int backlightPct = 100;
+  const char *manifest = NULL;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--hold") == 0 && i + 1 < argc)
+      hold = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc)
+      passes = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--backlight") == 0 && i + 1 < argc)
+      backlightPct = atoi(argv[++i]);
+    else if (argv[i][0] == '-' || manifest)
+      return 2;
+    else
+      manifest = argv[i];
+  }
+  if (!manifest || hold <= 0 || passes <= 0 || backlightPct <= 0)
+    return 2;
+
+  std::vector<TuneFrame> frames;
+  if (!loadFrames(manifest, &frames))
+    return 1;
+  if (frames.empty())
+  {
+    fprintf(stderr, "tune: no frames in %s\n", manifest);
+    return 1;
+  }
+
+  TuneResult fixed, tuned;
+  runSimulation(frames, false, hold, passes, backlightPct, &fixed);
+  printf("tuner changes (%zu frames x %d held, %d passes, backlight %d%%):\n", frames.size(), hold, passes,
+         backlightPct);
+  runSimulation(frames, true, hold, passes, backlightPct, &tuned);
+  printResult("fixed", fixed, frames);
+  printResult("tuned", tuned, frames);
+  return 0;
+}
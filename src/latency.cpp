@@ -0,0 +1,73 @@
+#ifdef LATENCY_TRACE
+
+#include <algorithm>
+#include <pthread.h>
+#include <string.h>
+#include "latency.h"
+
+static uint32_t samples[LAT_STAGE_COUNT][LATENCY_MAX_SAMPLES];
+static size_t written[LAT_STAGE_COUNT];
+static pthread_mutex_t latencyMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *const stageNames[LAT_STAGE_COUNT] = {
+    "capture",
+    "decode",
+    "result_handoff",
+    "beep_detect",
+    "beep_process",
+    "url_queue",
+    "http_get",
+    "actuate",
+    "scan_to_unlock",
+};
+
+void latencyRecord(LatencyStage stage, uint64_t startUs, uint64_t endUs)
+{
+  uint32_t us = endUs > startUs ? (uint32_t)(endUs - startUs) : 0;
+  pthread_mutex_lock(&latencyMutex);
+  samples[stage][written[stage] % LATENCY_MAX_SAMPLES] = us;
+  written[stage]++;
+  pthread_mutex_unlock(&latencyMutex);
+}
+
+// Nearest-rank percentile over a sorted array
+static uint32_t percentile(const uint32_t *sorted, size_t n, unsigned pct)
+{
+  size_t rank = (n * pct + 99) / 100;
+  return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+void latencySummarize(LatencyStage stage, LatencySummary *out)
+{
+  static uint32_t sorted[LATENCY_MAX_SAMPLES];
+
+  pthread_mutex_lock(&latencyMutex);
+  size_t n = std::min(written[stage], (size_t)LATENCY_MAX_SAMPLES);
+  memcpy(sorted, samples[stage], n * sizeof(uint32_t));
+  pthread_mutex_unlock(&latencyMutex);
+
+  memset(out, 0, sizeof(*out));
+  out->count = n;
+  if (n == 0)
+    return;
+
+  std::sort(sorted, sorted + n);
+  out->p50Us = percentile(sorted, n, 50);
+  out->p95Us = percentile(sorted, n, 95);
+  out->p99Us = percentile(sorted, n, 99);
+  out->maxUs = sorted[n - 1];
+}
+
+void latencyReset()
+{
+  pthread_mutex_lock(&latencyMutex);
+  memset(written, 0, sizeof(written));
+  pthread_mutex_unlock(&latencyMutex);
+}
+
+const char *latencyStageName(LatencyStage stage)
+{
+  return stageNames[stage];
+}
+
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+// Per-stage latency samples for the scan pipeline. Recording is compiled in
+// only when LATENCY_TRACE is defined (the native env does); otherwise the
+// calls are empty inlines and cost nothing on device.
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum LatencyStage
+{
+  LAT_CAPTURE,        // camera frame acquisition
+  LAT_DECODE,         // quirc identify + decode of one frame
+  LAT_RESULT_HANDOFF, // decoder result -> qrCodeTask
+  LAT_BEEP_DETECT,    // beepDetect() in qrCodeTask
+  LAT_BEEP_PROCESS,   // beepProcess() in qrCodeTask
+  LAT_URL_QUEUE,      // urlQueue send -> validation worker receive
+  LAT_HTTP,           // validation GET round trip
+  LAT_ACTUATE,        // access decision -> LOCK_PIN high
+  LAT_SCAN_TO_UNLOCK, // frame capture -> LOCK_PIN high
+  LAT_STAGE_COUNT
+};
+
+#define LATENCY_MAX_SAMPLES 1024 // per stage, oldest overwritten
+
+struct LatencySummary
+{
+  size_t count;
+  uint32_t p50Us;
+  uint32_t p95Us;
+  uint32_t p99Us;
+  uint32_t maxUs;
+};
+
+#ifdef LATENCY_TRACE
+void latencyRecord(LatencyStage stage, uint64_t startUs, uint64_t endUs);
+void latencySummarize(LatencyStage stage, LatencySummary *out);
+void latencyReset();
+const char *latencyStageName(LatencyStage stage);
+#else
+inline void latencyRecord(LatencyStage, uint64_t, uint64_t) {}
+#endif
@@ -5,13 +5,9 @@
 
 LiquidCrystal_I2C lcd(0x27, 16, 2);
 
-void lcdPrint(const char* message, int line, bool isClear) {
-  if(isClear)
-  {
-    lcd.clear();
-  }
-  lcd.setCursor(0, line);
-  lcd.print(message);
+void lcdWrite(int col, int line, const char* text, int len) {
+  lcd.setCursor(col, line);
+  lcd.write((const uint8_t*)text, len);
 }
 
 void lcdInit() {
@@ -22,11 +18,7 @@ void lcdInit() {
   lcd.print("initializing...");
 }
 
-void lcdClear() {
-  lcd.clear();
-}
-
-void lcdClearLine(int line) {
-  lcd.setCursor(0, line);
-  lcd.print("                    ");
+void lcdOff() {
+  lcd.noDisplay();
+  lcd.noBacklight();
 }
\ No newline at end of file
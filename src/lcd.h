@@ -1,13 +1,7 @@
 #pragma once // A common preprocessor directive to prevent multiple inclusions
 
-#include <LiquidCrystal_I2C.h>
-#include <Wire.h>
-
-// Extern declaration for the global LCD object
-extern LiquidCrystal_I2C lcd;
-
-// Function declarations with optional parameters
+// Raw HD44780 access. Everything after lcdInit() goes through display.h,
+// which decides what needs writing.
 void lcdInit();
-void lcdPrint(const char* message, int line = 0, bool isClear = true);
-void lcdClear();
-void lcdClearLine(int line);
\ No newline at end of file
+void lcdWrite(int col, int line, const char* text, int len); // overwrites len characters in place
+void lcdOff();
@@ -0,0 +1,150 @@
+#include <atomic>
+#include <stdarg.h>
+#include <stdio.h>
+#include "metrics.h"
+
+// Histogram bucket upper bounds. Counts are kept per bucket and made
+// cumulative when formatted.
+static const uint32_t bucketBoundsUs[] = {
+    1000, 2000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000,
+};
+#define BUCKET_COUNT (sizeof(bucketBoundsUs) / sizeof(bucketBoundsUs[0]) + 1) // + "+Inf"
+
+struct Histogram
+{
+  std::atomic<uint32_t> buckets[BUCKET_COUNT];
+  // In milliseconds, each observation rounded to the nearest: 64-bit atomics
+  // take a lock on the 32-bit Xtensa cores, and 32 bits of microseconds
+  // would wrap after 71 minutes of observed time. Milliseconds last 49 days.
+  std::atomic<uint32_t> sumMs;
+};
+
+static std::atomic<uint32_t> counters[MET_COUNTER_COUNT];
+static Histogram histograms[MET_HISTOGRAM_COUNT];
+
+// Status codes claim a slot on first use; slots hold code + 1 so that the
+// zeroed table reads as empty
+static std::atomic<int> httpCodes[METRICS_HTTP_CODES];
+static std::atomic<uint32_t> httpCounts[METRICS_HTTP_CODES];
+static std::atomic<uint32_t> httpOther;
+
+static const char *const counterNames[MET_COUNTER_COUNT][2] = {
+    {"qrscanner_frames_captured_total", "Frames published by the capture task."},
+    {"qrscanner_frames_decoded_total", "Frames passed to quirc after the decode gate."},
+    {"qrscanner_decode_failures_total", "Located QR codes whose payload did not decode."},
+    {"qrscanner_scans_debounced_total", "Repeated scans ignored by the debounce."},
+    {"qrscanner_scans_denied_recent_total", "Scans denied locally because the server refused the payload moments ago."},
+    {"qrscanner_url_queue_drops_total", "Scans dropped because the validation queue was full."},
+    {"qrscanner_lcd_updates_total", "Display changes sent to the LCD."},
+    {"qrscanner_lcd_chars_sent_total", "Characters written to the LCD over I2C."},
+};
+
+static const char *const histogramNames[MET_HISTOGRAM_COUNT][2] = {
+    {"qrscanner_decode_seconds", "quirc identify and decode time per frame."},
+    {"qrscanner_http_request_seconds", "Validation request round trip."},
+    {"qrscanner_scan_to_unlock_seconds", "Frame capture to lock release."},
+};
+
+void metricsCount(MetricCounter counter)
+{
+  counters[counter].fetch_add(1, std::memory_order_relaxed);
+}
+
+void metricsAdd(MetricCounter counter, uint32_t n)
+{
+  counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+void metricsHttpStatus(int code)
+{
+  for (int i = 0; i < METRICS_HTTP_CODES; i++)
+  {
+    int slot = httpCodes[i].load(std::memory_order_acquire);
+    if (slot == 0 && httpCodes[i].compare_exchange_strong(slot, code + 1, std::memory_order_acq_rel))
+      slot = code + 1;
+    if (slot == code + 1)
+    {
+      httpCounts[i].fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+  httpOther.fetch_add(1, std::memory_order_relaxed);
+}
+
+void metricsObserve(MetricHistogram histogram, uint64_t startUs, uint64_t endUs)
+{
+  uint64_t us = endUs > startUs ? endUs - startUs : 0;
+  size_t bucket = 0;
+  while (bucket < BUCKET_COUNT - 1 && us > bucketBoundsUs[bucket])
+    bucket++;
+  histograms[histogram].buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  histograms[histogram].sumMs.fetch_add((uint32_t)((us + 500) / 1000), std::memory_order_relaxed);
+}
+
+// ---------------------- FORMAT ----------------------
+struct Writer
+{
+  char *buf;
+  size_t len;
+  size_t used;
+  bool full;
+};
+
+static void emit(Writer *w, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void emit(Writer *w, const char *fmt, ...)
+{
+  if (w->full)
+    return;
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(w->buf + w->used, w->len - w->used, fmt, args);
+  va_end(args);
+  if (n < 0 || (size_t)n >= w->len - w->used)
+    w->full = true;
+  else
+    w->used += n;
+}
+
+size_t metricsFormat(char *buf, size_t len)
+{
+  Writer w = {buf, len, 0, len == 0};
+
+  for (int i = 0; i < MET_COUNTER_COUNT; i++)
+  {
+    emit(&w, "# HELP %s %s\n# TYPE %s counter\n", counterNames[i][0], counterNames[i][1], counterNames[i][0]);
+    emit(&w, "%s %lu\n", counterNames[i][0], (unsigned long)counters[i].load(std::memory_order_relaxed));
+  }
+
+  emit(&w, "# HELP qrscanner_http_responses_total Validation responses by status code (0 = no response).\n"
+           "# TYPE qrscanner_http_responses_total counter\n");
+  for (int i = 0; i < METRICS_HTTP_CODES; i++)
+  {
+    int slot = httpCodes[i].load(std::memory_order_acquire);
+    if (slot != 0)
+      emit(&w, "qrscanner_http_responses_total{code=\"%d\"} %lu\n", slot - 1,
+           (unsigned long)httpCounts[i].load(std::memory_order_relaxed));
+  }
+  emit(&w, "qrscanner_http_responses_total{code=\"other\"} %lu\n",
+       (unsigned long)httpOther.load(std::memory_order_relaxed));
+
+  for (int i = 0; i < MET_HISTOGRAM_COUNT; i++)
+  {
+    const char *name = histogramNames[i][0];
+    emit(&w, "# HELP %s %s\n# TYPE %s histogram\n", name, histogramNames[i][1], name);
+    // Buckets are read one at a time, so a scrape racing an update may be
+    // off by one observation; _count is the +Inf bucket so they agree
+    unsigned long cumulative = 0;
+    for (size_t b = 0; b < BUCKET_COUNT; b++)
+    {
+      cumulative += histograms[i].buckets[b].load(std::memory_order_relaxed);
+      if (b < BUCKET_COUNT - 1)
+        emit(&w, "%s_bucket{le=\"%g\"} %lu\n", name, bucketBoundsUs[b] / 1e6, cumulative);
+      else
+        emit(&w, "%s_bucket{le=\"+Inf\"} %lu\n", name, cumulative);
+    }
+    emit(&w, "%s_sum %.3f\n", name, histograms[i].sumMs.load(std::memory_order_relaxed) / 1e3);
+    emit(&w, "%s_count %lu\n", name, cumulative);
+  }
+
+  return w.full ? 0 : w.used;
+}
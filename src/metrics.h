@@ -0,0 +1,41 @@
+#pragma once
+
+// Always-on runtime counters and latency histograms, cheap enough for the
+// hot path: every update is a single relaxed atomic add, with no locks and
+// no allocation. The camera server renders them in the Prometheus text
+// format at /metrics.
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum MetricCounter
+{
+  MET_FRAMES_CAPTURED,     // frames published by the capture task
+  MET_FRAMES_DECODED,      // frames quirc ran on (past the decode gate)
+  MET_DECODE_FAILURES,     // a code was located but no payload decoded
+  MET_SCANS_DEBOUNCED,     // repeated payloads ignored by qrCodeTask
+  MET_SCANS_DENIED_RECENT, // payloads the server just refused, denied without asking
+  MET_URL_QUEUE_DROPS,     // scans dropped because urlQueue was full
+  MET_LCD_UPDATES,         // display changes sent to the LCD
+  MET_LCD_CHARS_SENT,      // characters written to the LCD over I2C
+  MET_COUNTER_COUNT
+};
+
+enum MetricHistogram
+{
+  MET_DECODE,         // quirc identify + decode of one frame
+  MET_HTTP,           // validation GET round trip
+  MET_SCAN_TO_UNLOCK, // frame capture -> LOCK_PIN high
+  MET_HISTOGRAM_COUNT
+};
+
+#define METRICS_HTTP_CODES 8 // distinct status codes tracked, the rest count as "other"
+
+void metricsCount(MetricCounter counter);
+void metricsAdd(MetricCounter counter, uint32_t n);
+void metricsHttpStatus(int code); // 0 = no response
+void metricsObserve(MetricHistogram histogram, uint64_t startUs, uint64_t endUs);
+
+// Writes every metric in the Prometheus text format. Returns the length
+// written, or 0 if buf is too small.
+size_t metricsFormat(char *buf, size_t len);
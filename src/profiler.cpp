@@ -0,0 +1,159 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "hal.h"
+#include "profiler.h"
+
+#define PROFILE_REPORT_BYTES 3072 // header + HAL_MAX_TASKS task lines + heaps
+#define PROFILE_MAX_HEAPS 4
+
+static HalMutex profileMutex;
+static char report[PROFILE_REPORT_BYTES];
+static size_t reportLen = 0;
+
+// Previous sample, for the CPU deltas
+static uint32_t prevIds[HAL_MAX_TASKS];
+static uint32_t prevRuntime[HAL_MAX_TASKS];
+static size_t prevCount = 0;
+static uint32_t prevTotal = 0;
+static uint32_t prevSampleMs = 0;
+
+static void append(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void append(const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(report + reportLen, sizeof(report) - reportLen, fmt, args);
+  va_end(args);
+  if (n > 0)
+    reportLen += (size_t)n < sizeof(report) - reportLen ? (size_t)n : sizeof(report) - reportLen - 1;
+}
+
+static bool previousRuntime(uint32_t id, uint32_t *runtime)
+{
+  for (size_t i = 0; i < prevCount; i++)
+  {
+    if (prevIds[i] == id)
+    {
+      *runtime = prevRuntime[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+// ---------------------- SAMPLE ----------------------
+static void buildReport()
+{
+  static HalTaskStat tasks[HAL_MAX_TASKS];
+  HalHeapStat heaps[PROFILE_MAX_HEAPS];
+  uint32_t total = 0;
+  size_t taskCount = halTaskStats(tasks, HAL_MAX_TASKS, &total);
+  size_t heapCount = halHeapStats(heaps, PROFILE_MAX_HEAPS);
+
+  uint32_t now = halMillis();
+  uint32_t totalDelta = prevSampleMs ? total - prevTotal : 0; // unsigned math survives the wrap
+  reportLen = 0;
+  append("profile: uptime %lu s, cpu over the last %lu s\n", (unsigned long)(now / 1000),
+         (unsigned long)(prevSampleMs ? (now - prevSampleMs) / 1000 : 0));
+  append("%-16s %4s %4s %6s %15s %8s\n", "task", "core", "prio", "cpu%", "stack used/size", "min free");
+
+  // Per-core busy share: pinned tasks other than the idle tasks
+  float coreBusy[2] = {0, 0};
+  float unpinnedBusy = 0;
+  for (size_t i = 0; i < taskCount; i++)
+  {
+    const HalTaskStat *task = &tasks[i];
+    uint32_t before;
+    float cpu = -1;
+    if (totalDelta > 0 && previousRuntime(task->id, &before))
+      cpu = 100.0f * (uint32_t)(task->runtime - before) / totalDelta;
+    if (cpu >= 0 && strncmp(task->name, "IDLE", 4) != 0)
+    {
+      if (task->core == 0 || task->core == 1)
+        coreBusy[task->core] += cpu;
+      else
+        unpinnedBusy += cpu;
+    }
+
+    char core[4], cpuText[8], stack[24];
+    snprintf(core, sizeof(core), task->core < 0 ? "-" : "%d", task->core);
+    snprintf(cpuText, sizeof(cpuText), cpu < 0 ? "-" : "%.1f", cpu);
+    if (task->stackBytes)
+      snprintf(stack, sizeof(stack), "%lu/%lu", (unsigned long)(task->stackBytes - task->stackMinFree),
+               (unsigned long)task->stackBytes);
+    else
+      snprintf(stack, sizeof(stack), "-");
+    append("%-16s %4s %4d %6s %15s %8lu\n", task->name, core, task->priority, cpuText, stack,
+           (unsigned long)task->stackMinFree);
+  }
+  if (totalDelta > 0)
+    append("busy: core 0 %.1f%%, core 1 %.1f%%, unpinned %.1f%%\n", coreBusy[0], coreBusy[1], unpinnedBusy);
+
+  for (size_t i = 0; i < heapCount; i++)
+  {
+    const HalHeapStat *heap = &heaps[i];
+    append("heap %s: %lu free of %lu", heap->name, (unsigned long)heap->freeBytes, (unsigned long)heap->totalBytes);
+    if (heap->largestFreeBlock && heap->freeBytes)
+      append(", largest block %lu (%lu%% fragmented)", (unsigned long)heap->largestFreeBlock,
+             (unsigned long)(100 - 100 * (uint64_t)heap->largestFreeBlock / heap->freeBytes));
+    if (heap->minFreeBytes)
+      append(", min free %lu", (unsigned long)heap->minFreeBytes);
+    append("\n");
+  }
+
+  prevCount = taskCount;
+  for (size_t i = 0; i < taskCount; i++)
+  {
+    prevIds[i] = tasks[i].id;
+    prevRuntime[i] = tasks[i].runtime;
+  }
+  prevTotal = total;
+  prevSampleMs = now ? now : 1;
+}
+
+void profilerSample()
+{
+  halMutexLock(profileMutex);
+  buildReport();
+  // Line by line: halLog truncates long messages on the device
+  const char *line = report;
+  while (*line)
+  {
+    const char *end = strchr(line, '\n');
+    int len = end ? (int)(end - line) : (int)strlen(line);
+    halLog("%.*s\n", len, line);
+    line += len + (end ? 1 : 0);
+  }
+  halMutexUnlock(profileMutex);
+}
+
+size_t profilerFormat(char *buf, size_t len)
+{
+  halMutexLock(profileMutex);
+  size_t n = reportLen < len ? reportLen : 0;
+  memcpy(buf, report, n);
+  halMutexUnlock(profileMutex);
+  return n;
+}
+
+// ---------------------- TASK ----------------------
+static void profileTask(void *arg)
+{
+  // Baseline for the first interval's CPU shares, not worth logging
+  halMutexLock(profileMutex);
+  buildReport();
+  halMutexUnlock(profileMutex);
+  while (true)
+  {
+    halDelayMs(PROFILE_INTERVAL_MS);
+    profilerSample();
+  }
+}
+
+bool profilerStart()
+{
+  profileMutex = halMutexCreate();
+  return profileMutex && halTaskCreate(profileTask, "Profile_Task", 4 * 1024, NULL, 1, 1);
+}
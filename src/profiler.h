@@ -0,0 +1,18 @@
+#pragma once
+
+// Periodic resource profile: per-task CPU share, stack high-water marks and
+// heap headroom/fragmentation per heap. A low-priority task samples every
+// PROFILE_INTERVAL_MS, logs the report and keeps it for /profile on the
+// camera server.
+
+#include <stddef.h>
+
+bool profilerStart();
+
+// Takes a sample now (CPU shares cover the time since the previous one),
+// logs it and keeps it as the latest report
+void profilerSample();
+
+// Copies the latest report into buf. Returns its length, or 0 if there is
+// no report yet or buf is too small.
+size_t profilerFormat(char *buf, size_t len);
@@ -0,0 +1,472 @@
+#include <stdlib.h>
+#include <string.h>
+#include <quirc.h>
+#include "binarize.h"
+#include "config.h"
+#include "metrics.h"
+#include "qr_decoder.h"
+
+#define ROI_ALIGN_PX 32        // crop edges snap to this grid
+#define ROI_CROP_DIV 2         // crop image is 1/N of the frame each way; bigger regions decode whole frames
+#define FINDER_ROW_STEP 2     // pre-scan every other row
+#define FINDER_MIN_MODULE_PX 2 // smaller modules don't decode reliably anyway
+#define FINDER_MAX_PER_ROW 16  // profiles kept per scanned row
+#define LUMA_SAMPLE_STEP 2     // region luma is sampled every Nth pixel each way
+
+// quirc_resize() reallocates its buffers, so whole frames and crops each
+// get their own instance, both sized when the frame size changes. A region
+// is widened to the crop size, so following a code never touches the heap.
+struct QuircImage
+{
+  struct quirc *q;
+  uint16_t width;
+  uint16_t height;
+};
+
+struct QrDecoder
+{
+  QuircImage full;
+  QuircImage crop;
+
+  // Motion gate: mean luma per tile of this and the previous frame
+  uint8_t *tiles;
+  uint8_t *prevTiles;
+  uint8_t *thresholds; // per tile, for the finder pre-scan
+  uint8_t *row;        // one binarized row
+  uint16_t tilesX;
+  uint16_t tilesY;
+  uint16_t frameWidth;
+  uint16_t frameHeight;
+  uint64_t activeUntilUs; // decode every frame until then
+  uint64_t lastDecodeUs;
+  uint64_t lastFullUs; // last decode of the whole frame
+
+  // Region around the last located code, in frame coordinates
+  bool roiValid;
+  uint16_t roiX;
+  uint16_t roiY;
+  uint16_t roiW;
+  uint16_t roiH;
+
+  // Updated by the decoding task only. Other tasks read the copy published
+  // under statsLock after each frame, so they never see a torn decodeUs.
+  QrDecodeStats stats;
+  QrDecodeStats published;
+  HalMutex statsLock;
+};
+
+QrDecoder *qrDecoderCreate()
+{
+  QrDecoder *decoder = (QrDecoder *)calloc(1, sizeof(QrDecoder));
+  if (!decoder)
+    return NULL;
+
+  decoder->full.q = quirc_new();
+  decoder->crop.q = quirc_new();
+  decoder->statsLock = halMutexCreate();
+  if (!decoder->full.q || !decoder->crop.q || !decoder->statsLock)
+  {
+    qrDecoderDestroy(decoder);
+    return NULL;
+  }
+  return decoder;
+}
+
+void qrDecoderDestroy(QrDecoder *decoder)
+{
+  if (!decoder)
+    return;
+  if (decoder->full.q)
+    quirc_destroy(decoder->full.q);
+  if (decoder->crop.q)
+    quirc_destroy(decoder->crop.q);
+  free(decoder->tiles);
+  free(decoder->prevTiles);
+  free(decoder->thresholds);
+  free(decoder->row);
+  free(decoder);
+}
+
+void qrDecoderStats(const QrDecoder *decoder, QrDecodeStats *out)
+{
+  halMutexLock(decoder->statsLock);
+  *out = decoder->published;
+  halMutexUnlock(decoder->statsLock);
+}
+
+static bool resizeImage(QuircImage *image, uint16_t width, uint16_t height)
+{
+  if (width == image->width && height == image->height)
+    return true;
+  if (quirc_resize(image->q, width, height) < 0)
+  {
+    image->width = image->height = 0;
+    return false;
+  }
+  image->width = width;
+  image->height = height;
+  return true;
+}
+
+// Updates the tile grid from frame and returns how many tiles changed. A new
+// frame size resets the grid and counts as a change.
+static int sceneChanges(QrDecoder *decoder, const HalFrame *frame)
+{
+  bool reset = frame->width != decoder->frameWidth || frame->height != decoder->frameHeight;
+  if (reset)
+  {
+    uint16_t tilesX = frame->width / BINARIZE_TILE_PX;
+    uint16_t tilesY = frame->height / BINARIZE_TILE_PX;
+    size_t tileCount = (size_t)tilesX * tilesY;
+    free(decoder->tiles);
+    free(decoder->prevTiles);
+    free(decoder->thresholds);
+    free(decoder->row);
+    decoder->tiles = (uint8_t *)malloc(tileCount);
+    decoder->prevTiles = (uint8_t *)malloc(tileCount);
+    decoder->thresholds = (uint8_t *)malloc(tileCount);
+    decoder->row = (uint8_t *)malloc((size_t)tilesX * BINARIZE_TILE_PX);
+    bool ok = decoder->tiles && decoder->prevTiles && decoder->thresholds && decoder->row;
+    decoder->tilesX = ok ? tilesX : 0;
+    decoder->tilesY = ok ? tilesY : 0;
+    decoder->frameWidth = frame->width;
+    decoder->frameHeight = frame->height;
+    decoder->stats.frameWidth = frame->width;
+    decoder->roiValid = false;
+
+    uint16_t cropW = (frame->width / ROI_CROP_DIV + ROI_ALIGN_PX - 1) / ROI_ALIGN_PX * ROI_ALIGN_PX;
+    uint16_t cropH = (frame->height / ROI_CROP_DIV + ROI_ALIGN_PX - 1) / ROI_ALIGN_PX * ROI_ALIGN_PX;
+    resizeImage(&decoder->full, frame->width, frame->height);
+    resizeImage(&decoder->crop, cropW < frame->width ? cropW : frame->width, cropH < frame->height ? cropH : frame->height);
+  }
+  if (decoder->tilesX == 0)
+    return 1;
+
+  uint8_t *prev = decoder->tiles;
+  decoder->tiles = decoder->prevTiles;
+  decoder->prevTiles = prev;
+  tileMeans(frame->buf, frame->width, frame->height, decoder->tiles);
+
+  int changed = 0;
+  uint32_t sum = 0, centerSum = 0, centerCount = 0;
+  for (uint16_t ty = 0; ty < decoder->tilesY; ty++)
+  {
+    bool centerRow = ty >= decoder->tilesY / 4 && ty < decoder->tilesY - decoder->tilesY / 4;
+    for (uint16_t tx = 0; tx < decoder->tilesX; tx++)
+    {
+      size_t i = (size_t)ty * decoder->tilesX + tx;
+      if (abs((int)decoder->tiles[i] - (int)prev[i]) > QR_GATE_DIFF)
+        changed++;
+      sum += decoder->tiles[i];
+      if (centerRow && tx >= decoder->tilesX / 4 && tx < decoder->tilesX - decoder->tilesX / 4)
+      {
+        centerSum += decoder->tiles[i];
+        centerCount++;
+      }
+    }
+  }
+  uint32_t edgeCount = (uint32_t)decoder->tilesX * decoder->tilesY - centerCount;
+  decoder->stats.centerLuma = centerCount ? (uint8_t)(centerSum / centerCount) : 0;
+  decoder->stats.edgeLuma = edgeCount ? (uint8_t)((sum - centerSum) / edgeCount) : decoder->stats.centerLuma;
+  return reset ? 1 : changed;
+}
+
+// Mean and 10th-90th percentile spread of the luma in a region, sampled
+// every LUMA_SAMPLE_STEP pixels
+static void regionLuma(const HalFrame *frame, uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t *mean,
+                       uint8_t *contrast)
+{
+  uint32_t histogram[32] = {0};
+  uint32_t sum = 0, count = 0;
+  for (uint16_t row = y; row < y + height; row += LUMA_SAMPLE_STEP)
+  {
+    const uint8_t *pixel = frame->buf + (size_t)row * frame->width + x;
+    for (uint16_t col = 0; col < width; col += LUMA_SAMPLE_STEP)
+    {
+      histogram[pixel[col] >> 3]++;
+      sum += pixel[col];
+      count++;
+    }
+  }
+  if (count == 0)
+  {
+    *mean = *contrast = 0;
+    return;
+  }
+
+  uint32_t seen = 0;
+  int low = -1, high = 31;
+  for (int bin = 0; bin < 32; bin++)
+  {
+    seen += histogram[bin];
+    if (low < 0 && seen * 10 >= count)
+      low = bin;
+    if (seen * 10 >= count * 9)
+    {
+      high = bin;
+      break;
+    }
+  }
+  *mean = sum / count ? (uint8_t)(sum / count) : 1; // 0 means "not measured"
+  *contrast = (uint8_t)((high - low) << 3);
+}
+
+// True if the five runs (dark, light, dark, light, dark) are roughly
+// 1:1:3:1:1, the profile of a line through a finder pattern
+static bool finderRatio(const uint16_t runs[5])
+{
+  int total = runs[0] + runs[1] + runs[2] + runs[3] + runs[4];
+  if (total < 7 * FINDER_MIN_MODULE_PX)
+    return false;
+
+  // Compare 7 * run with the expected share of total, allowing half a module
+  int slack = total / 2;
+  for (int i = 0; i < 5; i++)
+  {
+    int expected = i == 2 ? 3 * total : total;
+    if (abs(7 * runs[i] - expected) > (i == 2 ? 3 * slack : slack))
+      return false;
+  }
+  return true;
+}
+
+// Collects the centre x of every finder profile in a binarized row
+static int rowFinderCenters(const uint8_t *bits, uint16_t width, uint16_t *centers, int maxCenters)
+{
+  uint16_t runs[5] = {0}; // last five completed runs, oldest first
+  int completed = 0;
+  int found = 0;
+  uint8_t current = bits[0];
+  uint16_t length = 0;
+  for (uint16_t x = 0; x <= width && found < maxCenters; x++)
+  {
+    if (x < width && bits[x] == current)
+    {
+      length++;
+      continue;
+    }
+
+    runs[0] = runs[1];
+    runs[1] = runs[2];
+    runs[2] = runs[3];
+    runs[3] = runs[4];
+    runs[4] = length;
+    completed++;
+    if (current == 1 && completed >= 5 && finderRatio(runs))
+      centers[found++] = x - runs[4] - runs[3] - runs[2] / 2;
+
+    if (x < width)
+    {
+      current = bits[x];
+      length = 1;
+    }
+  }
+  return found;
+}
+
+// Cheap pre-scan before a full-frame decode: binarizes every other row
+// against its tiles' means and looks for a finder-pattern profile that
+// repeats at the same x on the next scanned row. Single-row matches are
+// common in sensor noise and textured clothing.
+static bool finderCandidate(QrDecoder *decoder, const HalFrame *frame)
+{
+  if (decoder->tilesX == 0)
+    return true; // no grid, let quirc decide
+
+  size_t tileCount = (size_t)decoder->tilesX * decoder->tilesY;
+  for (size_t i = 0; i < tileCount; i++)
+    decoder->thresholds[i] = (uint8_t)(decoder->tiles[i] * BINARIZE_DARK_PCT / 100);
+
+  uint16_t width = decoder->tilesX * BINARIZE_TILE_PX;
+  uint16_t height = decoder->tilesY * BINARIZE_TILE_PX;
+  uint16_t centers[2][FINDER_MAX_PER_ROW];
+  int counts[2] = {0, 0};
+  for (uint16_t y = 0, scan = 0; y < height; y += FINDER_ROW_STEP, scan++)
+  {
+    binarizeRow(frame->buf + (size_t)y * frame->width, width,
+                decoder->thresholds + (size_t)(y / BINARIZE_TILE_PX) * decoder->tilesX, decoder->row);
+
+    uint16_t *current = centers[scan & 1];
+    const uint16_t *previous = centers[(scan + 1) & 1];
+    int count = rowFinderCenters(decoder->row, width, current, FINDER_MAX_PER_ROW);
+    for (int i = 0; i < count; i++)
+    {
+      for (int j = 0; j < counts[(scan + 1) & 1]; j++)
+      {
+        if (abs((int)current[i] - (int)previous[j]) <= FINDER_ROW_STEP * FINDER_MIN_MODULE_PX)
+          return true;
+      }
+    }
+    counts[scan & 1] = count;
+  }
+  return false;
+}
+
+// Sets the crop for the next frames to code's bounding box plus a margin,
+// snapped outwards to ROI_ALIGN_PX. Corners are relative to the decoded window.
+static void updateRoi(QrDecoder *decoder, const struct quirc_code *code, int offsetX, int offsetY)
+{
+  int minX = code->corners[0].x, maxX = minX;
+  int minY = code->corners[0].y, maxY = minY;
+  for (int i = 1; i < 4; i++)
+  {
+    minX = code->corners[i].x < minX ? code->corners[i].x : minX;
+    maxX = code->corners[i].x > maxX ? code->corners[i].x : maxX;
+    minY = code->corners[i].y < minY ? code->corners[i].y : minY;
+    maxY = code->corners[i].y > maxY ? code->corners[i].y : maxY;
+  }
+
+  decoder->stats.codeWidth = (uint16_t)(maxX - minX);
+  int marginX = (maxX - minX) * QR_ROI_MARGIN_PCT / 100;
+  int marginY = (maxY - minY) * QR_ROI_MARGIN_PCT / 100;
+  int x0 = (offsetX + minX - marginX) / ROI_ALIGN_PX * ROI_ALIGN_PX;
+  int y0 = (offsetY + minY - marginY) / ROI_ALIGN_PX * ROI_ALIGN_PX;
+  int x1 = (offsetX + maxX + marginX + ROI_ALIGN_PX - 1) / ROI_ALIGN_PX * ROI_ALIGN_PX;
+  int y1 = (offsetY + maxY + marginY + ROI_ALIGN_PX - 1) / ROI_ALIGN_PX * ROI_ALIGN_PX;
+  x0 = x0 < 0 ? 0 : x0;
+  y0 = y0 < 0 ? 0 : y0;
+  x1 = x1 > decoder->frameWidth ? decoder->frameWidth : x1;
+  y1 = y1 > decoder->frameHeight ? decoder->frameHeight : y1;
+
+  decoder->roiValid = x1 > x0 && y1 > y0;
+  decoder->roiX = (uint16_t)x0;
+  decoder->roiY = (uint16_t)y0;
+  decoder->roiW = (uint16_t)(x1 - x0);
+  decoder->roiH = (uint16_t)(y1 - y0);
+}
+
+// Widens the region to the crop image's size, keeping it centred and inside
+// the frame. False when the region doesn't fit in the crop image.
+static bool fitCrop(QrDecoder *decoder, uint16_t *x, uint16_t *y, uint16_t *width, uint16_t *height)
+{
+  uint16_t w = decoder->crop.width;
+  uint16_t h = decoder->crop.height;
+  if (*width > w || *height > h)
+    return false;
+
+  int cx = *x - (w - *width) / 2;
+  int cy = *y - (h - *height) / 2;
+  cx = cx < 0 ? 0 : cx + w > decoder->frameWidth ? decoder->frameWidth - w : cx;
+  cy = cy < 0 ? 0 : cy + h > decoder->frameHeight ? decoder->frameHeight - h : cy;
+  *x = (uint16_t)cx;
+  *y = (uint16_t)cy;
+  *width = w;
+  *height = h;
+  return true;
+}
+
+static bool decodeFrame(QrDecoder *decoder, const HalFrame *frame, QrScan *out)
+{
+  if (frame->len < (size_t)frame->width * frame->height)
+    return false; // not a grayscale frame
+  decoder->stats.frames++;
+
+  // ---------- Motion gate ----------
+  uint64_t nowUs = frame->timestampUs;
+  if (sceneChanges(decoder, frame) > 0)
+  {
+    decoder->activeUntilUs = nowUs + QR_GATE_HOLD_MS * 1000ULL;
+    decoder->stats.motionMs = (uint32_t)(nowUs / 1000);
+  }
+  if (nowUs >= decoder->activeUntilUs && nowUs - decoder->lastDecodeUs < QR_GATE_REFRESH_MS * 1000ULL)
+  {
+    decoder->stats.skipped++;
+    return false;
+  }
+  decoder->lastDecodeUs = nowUs;
+
+  // ---------- Region of interest ----------
+  // The whole frame is still decoded every QR_GATE_REFRESH_MS so a second
+  // code elsewhere in view isn't missed
+  uint16_t x = 0, y = 0, width = frame->width, height = frame->height;
+  QuircImage *image = &decoder->full;
+  uint16_t roiX = decoder->roiX, roiY = decoder->roiY, roiW = decoder->roiW, roiH = decoder->roiH;
+  bool follow = decoder->roiValid && nowUs - decoder->lastFullUs < QR_GATE_REFRESH_MS * 1000ULL;
+  uint8_t codeLuma = 0, codeContrast = 0;
+  if (follow)
+    regionLuma(frame, roiX, roiY, roiW, roiH, &codeLuma, &codeContrast);
+  if (follow && fitCrop(decoder, &roiX, &roiY, &roiW, &roiH))
+  {
+    x = roiX;
+    y = roiY;
+    width = roiW;
+    height = roiH;
+    image = &decoder->crop;
+    decoder->stats.cropped++;
+  }
+  else
+  {
+    decoder->lastFullUs = nowUs;
+#if QR_FINDER_PRESCAN
+    if (!finderCandidate(decoder, frame))
+    {
+      decoder->stats.noFinder++;
+      return false;
+    }
+#endif
+  }
+  if (image->width != width || image->height != height)
+    return false; // quirc couldn't allocate for this frame size
+
+  struct quirc *q = image->q;
+  metricsCount(MET_FRAMES_DECODED);
+  uint64_t decodeStartUs = halMicros();
+  uint8_t *pixels = quirc_begin(q, NULL, NULL);
+  const uint8_t *src = frame->buf + (size_t)y * frame->width + x;
+  for (uint16_t row = 0; row < height; row++)
+    memcpy(pixels + (size_t)row * width, src + (size_t)row * frame->width, width);
+  quirc_end(q);
+
+  int count = quirc_count(q);
+  if (count == 0)
+  {
+    uint64_t endUs = halMicros();
+    metricsObserve(MET_DECODE, decodeStartUs, endUs);
+    decoder->stats.decodeUs += endUs - decodeStartUs;
+    // Lost it (or never had it): look at the whole frame next time
+    decoder->roiValid = false;
+    return false;
+  }
+
+  // A code in view keeps the decoder running even if it is held still
+  decoder->activeUntilUs = nowUs + QR_GATE_HOLD_MS * 1000ULL;
+
+  // Prefer the first code that decodes; otherwise report an invalid sighting
+  out->valid = false;
+  out->payload[0] = '\0';
+  out->frameUs = frame->timestampUs;
+  struct quirc_code code;
+  for (int i = 0; i < count; i++)
+  {
+    struct quirc_data data;
+    quirc_extract(q, i, &code);
+    if (quirc_decode(&code, &data) == QUIRC_SUCCESS)
+    {
+      size_t len = (size_t)data.payload_len < sizeof(out->payload) - 1 ? (size_t)data.payload_len : sizeof(out->payload) - 1;
+      memcpy(out->payload, data.payload, len);
+      out->payload[len] = '\0';
+      out->valid = true;
+      break;
+    }
+  }
+  if (!out->valid)
+    metricsCount(MET_DECODE_FAILURES);
+  uint64_t endUs = halMicros();
+  metricsObserve(MET_DECODE, decodeStartUs, endUs);
+  decoder->stats.decodeUs += endUs - decodeStartUs;
+  decoder->stats.located++;
+  decoder->stats.decoded += out->valid ? 1 : 0;
+  decoder->stats.codeLuma = codeLuma;
+  decoder->stats.codeContrast = codeContrast;
+  updateRoi(decoder, &code, x, y);
+  return true;
+}
+
+bool qrDecodeFrame(QrDecoder *decoder, const HalFrame *frame, QrScan *out)
+{
+  bool found = decodeFrame(decoder, frame, out);
+  halMutexLock(decoder->statsLock);
+  decoder->published = decoder->stats;
+  halMutexUnlock(decoder->statsLock);
+  return found;
+}
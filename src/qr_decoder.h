@@ -0,0 +1,47 @@
+#pragma once
+
+// Frame-level QR decode using quirc, the same library ESP32QRCodeReader
+// bundles. The camera backends run every captured frame through it on core 0.
+//
+// Frames pass a pre-decode gate first: the frame is reduced to a grid of
+// 16x16 luma tiles and compared with the previous one. In a static scene
+// quirc only runs every QR_GATE_REFRESH_MS. While something moves, and for
+// QR_GATE_HOLD_MS after that, every frame is decoded. Once a code has been
+// located, the following frames are cropped to the region around it.
+// Full-frame decodes are skipped when a binarized pre-scan finds no
+// finder-pattern profile (QR_FINDER_PRESCAN).
+
+#include "hal.h"
+
+struct QrDecoder;
+
+struct QrDecodeStats
+{
+  uint32_t frames;   // frames offered to qrDecodeFrame
+  uint32_t skipped;  // not decoded, scene static
+  uint32_t noFinder; // not decoded, pre-scan found no finder pattern
+  uint32_t cropped;  // decoded from the region around the last code only
+  uint32_t motionMs; // capture time (halMillis clock) of the last frame that differed from the one before
+
+  // For the sensor tuner (tuner.h)
+  uint32_t located;     // frames where quirc located a code
+  uint32_t decoded;     // of those, frames whose code decoded cleanly
+  uint64_t decodeUs;    // total time spent in quirc
+  uint16_t frameWidth;  // of the last frame
+  uint16_t codeWidth;   // bounding-box width of the last located code, px
+  uint8_t codeLuma;     // mean luma around the last located code, 0 = not measured (whole-frame decode)
+  uint8_t codeContrast; // 90th minus 10th percentile luma there
+  uint8_t centerLuma;   // mean luma of the middle quarter of the last frame, where codes are held up
+  uint8_t edgeLuma;     // mean luma of the rest of it
+};
+
+QrDecoder *qrDecoderCreate();
+void qrDecoderDestroy(QrDecoder *decoder);
+
+// Decodes the first QR code found in a grayscale frame. Returns true if a
+// code was located; out->valid reports whether its payload decoded cleanly.
+// Returns false without decoding when the gate skips the frame.
+bool qrDecodeFrame(QrDecoder *decoder, const HalFrame *frame, QrScan *out);
+
+// Safe from any task: copies the stats as of the last qrDecodeFrame().
+void qrDecoderStats(const QrDecoder *decoder, QrDecodeStats *out);
@@ -0,0 +1,98 @@
+#include "config.h"
+#include "hal.h"
+#include "recent.h"
+
+#define RECENT_WAYS 4
+
+struct RecentEntry
+{
+  uint64_t hash; // 0 = empty
+  uint32_t acceptedMs;
+  uint32_t decidedMs;
+  uint8_t outcome;
+};
+
+static RecentEntry table[RECENT_SCAN_SETS][RECENT_WAYS];
+static HalMutex recentMutex;
+
+static_assert((RECENT_SCAN_SETS & (RECENT_SCAN_SETS - 1)) == 0, "RECENT_SCAN_SETS must be a power of two");
+
+bool recentScanInit()
+{
+  recentMutex = halMutexCreate();
+  return recentMutex != NULL;
+}
+
+// 64-bit FNV-1a; 0 is kept for empty entries
+uint64_t recentScanHash(const char *payload)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char *p = payload; *p; p++)
+    hash = (hash ^ (uint8_t)*p) * 1099511628211ULL;
+  return hash ? hash : 1;
+}
+
+static RecentEntry *findLocked(uint64_t hash)
+{
+  RecentEntry *set = table[(hash ^ (hash >> 32)) & (RECENT_SCAN_SETS - 1)];
+  for (int way = 0; way < RECENT_WAYS; way++)
+  {
+    if (set[way].hash == hash)
+      return &set[way];
+  }
+  return NULL;
+}
+
+bool recentScanFind(uint64_t hash, RecentScan *out)
+{
+  halMutexLock(recentMutex);
+  RecentEntry *entry = findLocked(hash);
+  if (entry)
+  {
+    out->acceptedMs = entry->acceptedMs;
+    out->decidedMs = entry->decidedMs;
+    out->outcome = (RecentOutcome)entry->outcome;
+  }
+  halMutexUnlock(recentMutex);
+  return entry != NULL;
+}
+
+// The entry for hash, claiming an empty way or else the one accepted
+// longest ago if it has none
+static RecentEntry *claimLocked(uint64_t hash, uint32_t nowMs)
+{
+  RecentEntry *entry = findLocked(hash);
+  if (entry)
+    return entry;
+
+  RecentEntry *set = table[(hash ^ (hash >> 32)) & (RECENT_SCAN_SETS - 1)];
+  entry = &set[0];
+  for (int way = 0; way < RECENT_WAYS && entry->hash != 0; way++)
+  {
+    if (set[way].hash == 0 || nowMs - set[way].acceptedMs > nowMs - entry->acceptedMs)
+      entry = &set[way];
+  }
+  entry->hash = hash;
+  entry->acceptedMs = nowMs;
+  entry->decidedMs = nowMs;
+  entry->outcome = RECENT_PENDING;
+  return entry;
+}
+
+void recentScanAccepted(uint64_t hash, uint32_t nowMs)
+{
+  halMutexLock(recentMutex);
+  claimLocked(hash, nowMs)->acceptedMs = nowMs;
+  halMutexUnlock(recentMutex);
+}
+
+// A fast worker can decide before qrCodeTask records the acceptance, so
+// this claims the entry too
+void recentScanDecided(uint64_t hash, RecentOutcome outcome, uint32_t nowMs)
+{
+  halMutexLock(recentMutex);
+  RecentEntry *entry = claimLocked(hash, nowMs);
+  entry->outcome = (uint8_t)outcome;
+  entry->decidedMs = nowMs;
+  halMutexUnlock(recentMutex);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+// Payloads scanned in the last few minutes. qrCodeTask uses it to debounce
+// several people taking turns at the reader, and to answer a code the server
+// refused moments ago without asking again. A fixed set-associative table
+// of 64-bit payload hashes: lookups and updates are O(1), hash the payload
+// once, and allocate nothing. Safe to call from several tasks.
+
+#include <stdint.h>
+
+enum RecentOutcome
+{
+  RECENT_PENDING, // accepted, no verdict yet (or the server was unreachable)
+  RECENT_GRANTED,
+  RECENT_DENIED // refused by the server
+};
+
+struct RecentScan
+{
+  uint32_t acceptedMs; // last time the payload was handed to validation
+  uint32_t decidedMs;  // when the outcome was set
+  RecentOutcome outcome;
+};
+
+bool recentScanInit();
+
+uint64_t recentScanHash(const char *payload);
+
+// Returns false if hash isn't in the table.
+bool recentScanFind(uint64_t hash, RecentScan *out);
+
+// Notes that hash was accepted at nowMs, keeping its last outcome. A new
+// entry replaces the least recently accepted one in its set.
+void recentScanAccepted(uint64_t hash, uint32_t nowMs);
+
+// Sets the verdict for hash, adding it if it isn't in the table.
+void recentScanDecided(uint64_t hash, RecentOutcome outcome, uint32_t nowMs);
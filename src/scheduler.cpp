@@ -0,0 +1,241 @@
+#include <atomic>
+#include "scheduler.h"
+
+#define SCHED_SLOT_MASK (SCHED_WHEEL_SLOTS - 1)
+
+static_assert((SCHED_WHEEL_SLOTS & SCHED_SLOT_MASK) == 0, "SCHED_WHEEL_SLOTS must be a power of two");
+static_assert(SCHED_MAX_SIGNALS <= 32, "signals are bits of one word");
+
+struct SchedSignal
+{
+  SchedFn fn;
+  void *arg;
+};
+
+static SchedTimer *wheel[SCHED_WHEEL_SLOTS];
+static uint32_t armedCount;
+static uint32_t cursorMs;   // slots before this time have been run
+static uint32_t cursorSlot; // the slot cursorMs falls in
+static HalMutex wheelLock;
+static HalEvent wake; // NULL until the task runs: schedRun() is driven by hand
+static uint32_t wakeMs; // when the task wakes next, if wakeSet
+static bool wakeSet;
+
+static SchedSignal signals[SCHED_MAX_SIGNALS];
+static int signalCount;
+static std::atomic<uint32_t> raised(0);
+
+// ---------------------- WHEEL ----------------------
+// Slots are counted from the cursor using differences of halMillis() times,
+// which stay right across the 32-bit wrap (every 49.7 days). A deadline the
+// wheel has already passed counts as the cursor's own slot.
+static uint32_t ticksAhead(uint32_t dueMs)
+{
+  int32_t aheadMs = (int32_t)(dueMs - cursorMs);
+  return aheadMs > 0 ? (uint32_t)aheadMs / SCHED_TICK_MS : 0;
+}
+
+static void wheelRemove(SchedTimer *timer)
+{
+  *timer->link = timer->next;
+  if (timer->next)
+    timer->next->link = timer->link;
+  timer->armed = false;
+  armedCount--;
+}
+
+static void wheelInsert(SchedTimer *timer)
+{
+  // An empty wheel may not have turned for days: restart it at this
+  // deadline rather than count from a stale cursor
+  if (armedCount == 0)
+    cursorMs = timer->dueMs;
+  SchedTimer **head = &wheel[(cursorSlot + ticksAhead(timer->dueMs)) & SCHED_SLOT_MASK];
+  timer->next = *head;
+  timer->link = head;
+  if (*head)
+    (*head)->link = &timer->next;
+  *head = timer;
+  timer->armed = true;
+  armedCount++;
+}
+
+// Takes one timer due at nowMs off the wheel, visiting the slots from the
+// cursor up to nowMs. Returns NULL when none is due.
+static SchedTimer *popDue(uint32_t nowMs)
+{
+  uint32_t nowTicks = ticksAhead(nowMs); // a clock behind the wheel never turns it back
+  uint32_t ticks = nowTicks + 1;
+  if (ticks > SCHED_WHEEL_SLOTS)
+    ticks = SCHED_WHEEL_SLOTS; // slept through a whole revolution: every slot once
+  for (uint32_t i = 0; i < ticks; i++)
+  {
+    for (SchedTimer *timer = wheel[(cursorSlot + i) & SCHED_SLOT_MASK]; timer; timer = timer->next)
+    {
+      if ((int32_t)(timer->dueMs - nowMs) <= 0)
+      {
+        wheelRemove(timer);
+        return timer;
+      }
+    }
+  }
+  cursorSlot = (cursorSlot + nowTicks) & SCHED_SLOT_MASK;
+  cursorMs += nowTicks * SCHED_TICK_MS;
+  return NULL;
+}
+
+// Time from nowMs to the earliest deadline, once popDue() has found none due.
+// The first slot from the cursor holding a deadline of this revolution holds
+// the earliest one.
+static uint32_t untilNext(uint32_t nowMs)
+{
+  if (armedCount == 0)
+    return HAL_WAIT_FOREVER;
+  for (uint32_t i = 0; i < SCHED_WHEEL_SLOTS; i++)
+  {
+    bool found = false;
+    uint32_t earliestMs = 0;
+    for (SchedTimer *timer = wheel[(cursorSlot + i) & SCHED_SLOT_MASK]; timer; timer = timer->next)
+    {
+      if (ticksAhead(timer->dueMs) == i && (!found || (int32_t)(timer->dueMs - earliestMs) < 0))
+      {
+        earliestMs = timer->dueMs;
+        found = true;
+      }
+    }
+    if (found)
+      return (int32_t)(earliestMs - nowMs) > 0 ? earliestMs - nowMs : 0;
+  }
+  // Everything armed is more than a revolution away: check again then
+  int32_t revolutionMs = (int32_t)(cursorMs + SCHED_WHEEL_SLOTS * SCHED_TICK_MS - nowMs);
+  return revolutionMs > 0 ? revolutionMs : 0;
+}
+
+// ---------------------- TIMERS ----------------------
+void schedTimerInit(SchedTimer *timer, SchedFn fn, void *arg)
+{
+  timer->fn = fn;
+  timer->arg = arg;
+  timer->dueMs = 0;
+  timer->armed = false;
+  timer->next = NULL;
+  timer->link = NULL;
+}
+
+void schedAt(SchedTimer *timer, uint32_t dueMs)
+{
+  halMutexLock(wheelLock);
+  if (timer->armed)
+    wheelRemove(timer);
+  timer->dueMs = dueMs;
+  wheelInsert(timer);
+  // Only a deadline before the task's next wake needs to cut its sleep short
+  bool sooner = !wakeSet || (int32_t)(dueMs - wakeMs) < 0;
+  if (sooner)
+  {
+    wakeMs = dueMs;
+    wakeSet = true;
+  }
+  halMutexUnlock(wheelLock);
+
+  if (sooner && wake)
+    halEventSignal(wake);
+}
+
+void schedAfter(SchedTimer *timer, uint32_t delayMs)
+{
+  schedAt(timer, halMillis() + delayMs);
+}
+
+void schedCancel(SchedTimer *timer)
+{
+  halMutexLock(wheelLock);
+  if (timer->armed)
+    wheelRemove(timer);
+  halMutexUnlock(wheelLock);
+}
+
+bool schedArmed(const SchedTimer *timer)
+{
+  return timer->armed;
+}
+
+// ---------------------- SIGNALS ----------------------
+int schedSignalCreate(SchedFn fn, void *arg)
+{
+  halMutexLock(wheelLock);
+  int signal = signalCount < SCHED_MAX_SIGNALS ? signalCount++ : -1;
+  if (signal >= 0)
+    signals[signal] = {fn, arg};
+  halMutexUnlock(wheelLock);
+  return signal;
+}
+
+void schedRaise(int signal)
+{
+  raised.fetch_or(1UL << signal, std::memory_order_release);
+  if (wake)
+    halEventSignal(wake);
+}
+
+void HAL_ISR_ATTR schedRaiseFromIsr(int signal)
+{
+  raised.fetch_or(1UL << signal, std::memory_order_release);
+  if (wake)
+    halEventSignalFromIsr(wake);
+}
+
+// ---------------------- RUN ----------------------
+uint32_t schedRun(uint32_t nowMs)
+{
+  uint32_t pending = raised.exchange(0, std::memory_order_acquire);
+  for (int signal = 0; pending; signal++, pending >>= 1)
+  {
+    if (pending & 1)
+      signals[signal].fn(signals[signal].arg);
+  }
+
+  // One at a time, without the lock, so a handler can re-arm its own timer
+  // or any other
+  while (true)
+  {
+    halMutexLock(wheelLock);
+    SchedTimer *timer = popDue(nowMs);
+    halMutexUnlock(wheelLock);
+    if (!timer)
+      break;
+    timer->fn(timer->arg);
+  }
+
+  halMutexLock(wheelLock);
+  uint32_t waitMs = untilNext(nowMs);
+  wakeMs = nowMs + waitMs;
+  wakeSet = waitMs != HAL_WAIT_FOREVER;
+  halMutexUnlock(wheelLock);
+  return waitMs;
+}
+
+static void schedulerTask(void *arg)
+{
+  (void)arg;
+  while (true)
+  {
+    uint32_t waitMs = schedRun(halMillis());
+    halEventWait(wake, waitMs);
+  }
+}
+
+bool schedulerInit()
+{
+  wheelLock = halMutexCreate();
+  cursorMs = halMillis();
+  return wheelLock != NULL;
+}
+
+bool schedulerStart(uint32_t stackBytes, int priority, int core)
+{
+  wake = halEventCreate();
+  if (!wake)
+    return false;
+  return halTaskCreate(schedulerTask, "Scheduler_Task", stackBytes, NULL, priority, core);
+}
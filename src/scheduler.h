@@ -0,0 +1,61 @@
+#pragma once
+
+// One task for every deadline in the app: relocking, the restart button,
+// the power tiers and sensor tuning. Timers are caller-owned and sit in a
+// hashed timer wheel, so arming and cancelling are O(1). Each timer keeps
+// its exact deadline: the scheduler sleeps until the earliest one and
+// fires it on time, not on the next tick. Signals are raised from
+// interrupts (or tasks) and run their handler on the scheduler task.
+//
+// Handlers run one at a time on the scheduler task, so state they share
+// needs no lock. They must not block for long: every other deadline waits
+// behind them.
+//
+// schedRun() takes the time as an argument, so on the host the wheel can be
+// driven from a virtual clock without the task (`program sched`).
+
+#include <stdint.h>
+#include "hal.h"
+
+#define SCHED_TICK_MS 10      // wheel slot width
+#define SCHED_WHEEL_SLOTS 64  // one revolution is 640 ms; later deadlines wait in their slot
+#define SCHED_MAX_SIGNALS 8
+
+typedef void (*SchedFn)(void *arg);
+
+struct SchedTimer
+{
+  SchedFn fn;
+  void *arg;
+  uint32_t dueMs; // halMillis() time
+  bool armed;
+  SchedTimer *next; // in its wheel slot
+  SchedTimer **link; // the pointer to this timer in its slot
+};
+
+// Creates the wheel's lock. Call once, before any other sched function.
+bool schedulerInit();
+
+// Starts the scheduler task.
+bool schedulerStart(uint32_t stackBytes, int priority, int core);
+
+void schedTimerInit(SchedTimer *timer, SchedFn fn, void *arg);
+
+// Arms timer to fire at dueMs, moving it if it is already armed. Past
+// deadlines fire at once. Safe from any task, including from a handler.
+void schedAt(SchedTimer *timer, uint32_t dueMs);
+void schedAfter(SchedTimer *timer, uint32_t delayMs); // from halMillis()
+void schedCancel(SchedTimer *timer);
+bool schedArmed(const SchedTimer *timer);
+
+// Registers fn to run on the scheduler task when the signal is raised.
+// Returns the signal id, or -1 when all SCHED_MAX_SIGNALS are taken.
+int schedSignalCreate(SchedFn fn, void *arg);
+
+// Raising a signal that is already pending runs its handler once.
+void schedRaise(int signal);
+void schedRaiseFromIsr(int signal);
+
+// Runs pending signals and every timer due at nowMs. Returns how long the
+// scheduler may sleep before the next deadline (HAL_WAIT_FOREVER if none).
+uint32_t schedRun(uint32_t nowMs);
@@ -0,0 +1,139 @@
+#include "config.h"
+#include "tuner.h"
+
+#define TUNE_AE_MAX 2
+#define TUNE_GAIN_START 1 // 4x
+#define TUNE_GAIN_MAX 6   // 128x
+
+// A flat code region is pushed into this narrower band around mid-grey
+#define TUNE_FLAT_LOW ((TUNE_LUMA_LOW + 128) / 2)
+#define TUNE_FLAT_HIGH ((TUNE_LUMA_HIGH + 128) / 2)
+
+static CameraTuning current;
+static CameraTuning previous; // before the change on trial
+static bool onTrial;
+static int trialBaselinePct; // decode rate of the window before the change
+static bool trialLocated;    // whether that window located a code
+
+static QrDecodeStats windowStart;
+static uint32_t windowStartMs;
+static bool windowOpen;
+static uint32_t holdUntilMs;
+
+void tunerInit(CameraTuning *out)
+{
+  current.highRes = false;
+  current.aeLevel = 0;
+  current.gainCeiling = TUNE_GAIN_START;
+  onTrial = false;
+  windowOpen = false;
+  holdUntilMs = 0;
+  *out = current;
+}
+
+// +1 to brighten the code region, -1 to darken it, 0 to leave it
+static int exposureDirection(const QrDecodeStats *stats, bool located, bool backlit)
+{
+  if (located && stats->codeLuma != 0)
+  {
+    bool flat = stats->codeContrast < TUNE_MIN_CONTRAST;
+    if (stats->codeLuma < (flat ? TUNE_FLAT_LOW : TUNE_LUMA_LOW))
+      return 1;
+    if (stats->codeLuma > (flat ? TUNE_FLAT_HIGH : TUNE_LUMA_HIGH))
+      return -1;
+    return 0;
+  }
+  return backlit ? 1 : 0;
+}
+
+// The next settings to try, or current when nothing should change
+static CameraTuning nextStep(const QrDecodeStats *stats, uint32_t attempts, uint32_t located, uint32_t decoded,
+                             uint64_t decodeUs, bool backlit)
+{
+  CameraTuning next = current;
+  if (current.highRes && attempts > 0 && decodeUs / attempts > TUNE_FRAME_BUDGET_MS * 1000ULL)
+  {
+    next.highRes = false;
+    return next;
+  }
+
+  int direction = exposureDirection(stats, located > 0, backlit);
+  if (direction > 0 && current.aeLevel < TUNE_AE_MAX)
+    next.aeLevel++;
+  else if (direction > 0 && located > 0 && current.gainCeiling < TUNE_GAIN_MAX)
+    next.gainCeiling++;
+  else if (direction < 0 && current.gainCeiling > TUNE_GAIN_START)
+    next.gainCeiling--; // extra gain is the first to go: it adds noise
+  else if (direction < 0 && current.aeLevel > -TUNE_AE_MAX)
+    next.aeLevel--;
+  else if (located > 0 && stats->frameWidth > 0)
+  {
+    uint32_t codePct = (uint32_t)stats->codeWidth * 100 / stats->frameWidth;
+    bool failing = decoded * 2 < located;
+    if (!current.highRes && failing && codePct < TUNE_SMALL_CODE_PCT)
+      next.highRes = true;
+    else if (current.highRes && !failing && codePct > TUNE_LARGE_CODE_PCT)
+      next.highRes = false;
+  }
+  return next;
+}
+
+static bool sameTuning(const CameraTuning *a, const CameraTuning *b)
+{
+  return a->highRes == b->highRes && a->aeLevel == b->aeLevel && a->gainCeiling == b->gainCeiling;
+}
+
+bool tunerUpdate(const QrDecodeStats *stats, uint32_t nowMs, CameraTuning *out)
+{
+  if (!windowOpen || stats->frames < windowStart.frames) // first call, or the decoder was replaced
+  {
+    windowStart = *stats;
+    windowStartMs = nowMs;
+    windowOpen = true;
+    return false;
+  }
+  if (nowMs - windowStartMs < TUNE_WINDOW_MS)
+    return false;
+
+  uint32_t active = (stats->frames - windowStart.frames) - (stats->skipped - windowStart.skipped); // past the gate
+  uint32_t attempts = active - (stats->noFinder - windowStart.noFinder);                            // reached quirc
+  uint32_t located = stats->located - windowStart.located;
+  uint32_t decoded = stats->decoded - windowStart.decoded;
+  uint64_t decodeUs = stats->decodeUs - windowStart.decodeUs;
+  windowStart = *stats;
+  windowStartMs = nowMs;
+
+  // A window with nobody in front says nothing about the settings
+  bool backlit = located == 0 && stats->centerLuma + TUNE_BACKLIGHT_DIFF < stats->edgeLuma;
+  if (active < TUNE_MIN_FRAMES || (located == 0 && !backlit))
+    return false;
+  int ratePct = (int)(decoded * 100 / active);
+
+  // A trial is only judged against a window like the one before it. A code
+  // walking out of view isn't the change's fault, so the change stays.
+  if (onTrial)
+  {
+    onTrial = false;
+    if ((located > 0) == trialLocated && ratePct + TUNE_REVERT_PCT <= trialBaselinePct)
+    {
+      current = previous;
+      holdUntilMs = nowMs + TUNE_HOLD_MS;
+      *out = current;
+      return true;
+    }
+  }
+  if ((int32_t)(nowMs - holdUntilMs) < 0)
+    return false;
+
+  CameraTuning next = nextStep(stats, attempts, located, decoded, decodeUs, backlit);
+  if (sameTuning(&next, &current))
+    return false;
+
+  previous = current;
+  current = next;
+  onTrial = true;
+  trialBaselinePct = ratePct;
+  trialLocated = located > 0;
+  *out = current;
+  return true;
+}
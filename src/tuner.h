@@ -0,0 +1,30 @@
+#pragma once
+
+// Closed-loop sensor tuning. The decoder's counters are judged over windows
+// of TUNE_WINDOW_MS in which something was in front of the camera. From
+// them the tuner works out the decode rate, the luma and contrast around the
+// last located code, the code's size and the decode time. With no code
+// located, it checks whether the centre is darker than the edges (backlit).
+// At most one setting changes per window, in this order of precedence:
+//   - back to QVGA when VGA decodes take longer than TUNE_FRAME_BUDGET_MS
+//   - exposure target, then gain ceiling, towards a readable code region
+//     (a backlit centre only moves the exposure target)
+//   - VGA for small codes that are located but fail to decode; QVGA again,
+//     for the frame rate, once codes are large and close
+// A change is on trial for the next window. If the decode rate drops by
+// TUNE_REVERT_PCT points, the change is undone and the settings are held for
+// TUNE_HOLD_MS.
+//
+// Pure logic with no HAL calls: the caller applies the settings with
+// halCameraTune(), and `program tune` drives it from recorded frames.
+
+#include <stdint.h>
+#include "hal.h"
+#include "qr_decoder.h"
+
+// Resets the tuner and returns the settings to start from.
+void tunerInit(CameraTuning *out);
+
+// Feeds the decoder's counters at nowMs. Returns true with the new settings
+// in out when they should change.
+bool tunerUpdate(const QrDecodeStats *stats, uint32_t nowMs, CameraTuning *out);